@@ -0,0 +1,249 @@
+#include <array>
+#include <vector>
+#include <cassert>
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <csignal>
+#include <cerrno>
+#include <cstring>
+#if defined(__linux__)
+#include <sys/time.h>
+#endif
+
+#include <MultiArena/MultiArena.h>
+
+using std::cout;
+
+#if defined(__linux__)
+// Example 10.4: A SIGALRM handler which allocates crash report buffers
+// while the interrupted thread is allocating from the same resource.
+namespace SignalExample
+{
+    MultiArena::SignalSafeArenaResource<64, 4096> resource;
+    constexpr std::size_t reportSize = 96;
+    std::array<unsigned char*, 8> reports {};  // Touched only by the handler.
+    volatile std::sig_atomic_t numSignals = 0;
+    volatile std::sig_atomic_t numCorrupted = 0;
+
+    void onAlarm(int)
+    {
+        int savedErrno = errno;
+        unsigned char*& report = reports[numSignals % reports.size()];
+        if (report) { // Recycle the oldest report.
+            for (std::size_t i = 0; i < reportSize; ++i)
+                if (report[i] != 0xab)
+                    numCorrupted = numCorrupted + 1;
+            resource.deallocate(report, reportSize);
+        }
+        report = static_cast<unsigned char*>(resource.tryAllocate(reportSize));
+        if (report)
+            std::memset(report, 0xab, reportSize);
+        numSignals = numSignals + 1;
+        errno = savedErrno;
+    }
+} // namespace SignalExample
+#endif
+
+int main()
+{
+    // Example 10.1: Split the arenas into per-CPU shards.
+    cout << "\n*** Example 10.1 *** Sharded vs. single synchronized resource.\n";
+    {
+        using namespace MultiArena;
+        constexpr int numOpsPerThread = 200000;
+
+        // Each thread keeps allocating small blocks and freeing them in batches.
+        auto runBenchmark = [&](std::pmr::memory_resource& resource, int numThreads)
+        {
+            auto job = [&] {
+                std::array<void*, 64> blocks;
+                for (int i = 0; i < numOpsPerThread; i += int(blocks.size())) {
+                    for (std::size_t k = 0; k < blocks.size(); ++k)
+                        blocks[k] = resource.allocate(32 + (k % 8) * 16);
+                    for (std::size_t k = 0; k < blocks.size(); ++k)
+                        resource.deallocate(blocks[k], 32 + (k % 8) * 16);
+                }
+            };
+            auto start = std::chrono::steady_clock::now();
+            std::vector<std::thread> threads;
+            for (int t = 0; t < numThreads; ++t)
+                threads.emplace_back(job);
+            for (std::thread& t : threads)
+                t.join();
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            return numThreads * numOpsPerThread / elapsed.count() / 1000.0; // Million ops per second
+        };
+
+        SynchronizedArenaResource syncResource(256, 16 * 1024);
+        ShardedArenaResource shardedResource(256, 16 * 1024);
+        cout << "  " << shardedResource.numShards() << " shards. Million allocations per second:\n";
+        for (int numThreads : {1, 2, 4, 8}) {
+            double syncRate = runBenchmark(syncResource, numThreads);
+            double shardedRate = runBenchmark(shardedResource, numThreads);
+            cout << "  " << numThreads << " threads: synchronized " << syncRate << ", sharded " << shardedRate << "\n";
+        }
+        cout << "  " << shardedResource.numberOfSteals() << " arenas stolen between shards.\n";
+    }
+
+    // Example 10.2: Recycle arenas without the exclusive lock.
+    cout << "\n*** Example 10.2 *** Arena recycling with the lock-free free list.\n";
+    {
+        using namespace MultiArena;
+        constexpr int numOpsPerThread = 200000;
+        constexpr std::size_t numLive = 16; // Blocks kept alive by each thread.
+
+        // Small arenas and blocks which outlive the arena they were allocated from
+        // so that most arenas are released by a deallocation. Each block is filled with
+        // a pattern which is checked before it is freed.
+        auto runBenchmark = [&](auto& resource, int numThreads, std::atomic<int>& numCorrupted)
+        {
+            auto job = [&](int threadId) {
+                std::array<unsigned char*, numLive> blocks {};
+                std::array<std::size_t, numLive> sizes {};
+                for (int i = 0; i < numOpsPerThread; ++i) {
+                    std::size_t k = i % numLive;
+                    if (blocks[k]) {
+                        for (std::size_t j = 0; j < sizes[k]; ++j)
+                            if (blocks[k][j] != (unsigned char)(threadId + k))
+                                ++numCorrupted;
+                        resource.deallocate(blocks[k], sizes[k]);
+                    }
+                    sizes[k] = 16 + (i % 7) * 24;
+                    blocks[k] = static_cast<unsigned char*>(resource.allocate(sizes[k]));
+                    std::fill_n(blocks[k], sizes[k], (unsigned char)(threadId + k));
+                }
+                for (std::size_t k = 0; k < numLive; ++k)
+                    resource.deallocate(blocks[k], sizes[k]);
+            };
+            auto start = std::chrono::steady_clock::now();
+            std::vector<std::thread> threads;
+            for (int t = 0; t < numThreads; ++t)
+                threads.emplace_back(job, t);
+            for (std::thread& t : threads)
+                t.join();
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            return numThreads * numOpsPerThread / elapsed.count() / 1000.0; // Million ops per second
+        };
+
+        SynchronizedArenaResource resource(512, 1024);
+        std::atomic<int> numCorrupted = 0;
+        cout << "  Million allocate/deallocate pairs per second with 1 KiB arenas:\n";
+        for (int numThreads : {1, 2, 4, 8}) {
+            double lifoRate = runBenchmark(resource, numThreads, numCorrupted);
+            resource.setArenaSelectionPolicy(ArenaSelectionPolicy::Ring);
+            double ringRate = runBenchmark(resource, numThreads, numCorrupted);
+            resource.setArenaSelectionPolicy(ArenaSelectionPolicy::Lifo);
+            cout << "  " << numThreads << " threads: Lifo stack " << lifoRate << ", Ring bitmap " << ringRate << "\n";
+        }
+        cout << "  " << numCorrupted << " corrupted bytes, " << resource.numberOfBusyArenas() << " busy arenas left.\n";
+        assert(numCorrupted == 0 && resource.numberOfBusyArenas() == 0);
+    }
+
+    // Example 10.3: Arena utilization and throughput when many threads race at the end of the active arena.
+    cout << "\n*** Example 10.3 *** Bounded bump of the synchronized resource under many threads.\n";
+    {
+        using namespace MultiArena;
+        constexpr SizeType numArenas = 64;
+        constexpr SizeType arenaSize = 16 * 1024;
+
+        // Every thread allocates blocks without freeing them until the resource runs out
+        // of arenas. The block sizes are either all 1 KiB, so the last block of each arena
+        // fits it exactly, or mixed powers of two from 16 bytes to 1 KiB. The utilization
+        // is the share of the capacity of the resource which was handed out.
+        auto measureUtilization = [&](int numThreads, bool bMixedSizes)
+        {
+            SynchronizedArenaResource resource(numArenas, arenaSize);
+            std::atomic<std::size_t> numBytesAllocated = 0;
+            auto job = [&](int threadId) {
+                try {
+                    for (int i = threadId; ; ++i) {
+                        std::size_t size = bMixedSizes ? std::size_t(16) << (i % 7) : 1024;
+                        if (!resource.allocate(size))
+                            break;
+                        numBytesAllocated += size;
+                    }
+                }
+                catch (OutOfFreeArenas&) {}
+            };
+            std::vector<std::thread> threads;
+            for (int t = 0; t < numThreads; ++t)
+                threads.emplace_back(job, t);
+            for (std::thread& t : threads)
+                t.join();
+            return 100.0 * numBytesAllocated / (std::size_t(numArenas) * arenaSize);
+        };
+
+        // Each thread keeps allocating small blocks and freeing them in batches.
+        auto measureThroughput = [&](int numThreads)
+        {
+            constexpr int numOpsPerThread = 100000;
+            SynchronizedArenaResource resource(256, arenaSize);
+            auto job = [&] {
+                std::array<void*, 64> blocks;
+                for (int i = 0; i < numOpsPerThread; i += int(blocks.size())) {
+                    for (std::size_t k = 0; k < blocks.size(); ++k)
+                        blocks[k] = resource.allocate(32 + (k % 8) * 16);
+                    for (std::size_t k = 0; k < blocks.size(); ++k)
+                        resource.deallocate(blocks[k], 32 + (k % 8) * 16);
+                }
+            };
+            auto start = std::chrono::steady_clock::now();
+            std::vector<std::thread> threads;
+            for (int t = 0; t < numThreads; ++t)
+                threads.emplace_back(job);
+            for (std::thread& t : threads)
+                t.join();
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            return numThreads * numOpsPerThread / elapsed.count() / 1000.0; // Million ops per second
+        };
+
+        for (int numThreads : {1, 16, 32}) {
+            cout << "  " << numThreads << " threads: utilization " << measureUtilization(numThreads, false) << "% (1 KiB blocks), "
+                 << measureUtilization(numThreads, true) << "% (mixed), "
+                 << measureThroughput(numThreads) << " million allocations per second.\n";
+        }
+    }
+
+#if defined(__linux__)
+    // Example 10.4: Allocate in a signal handler.
+    cout << "\n*** Example 10.4 *** Allocation in a SIGALRM handler which interrupts allocations.\n";
+    {
+        using namespace SignalExample;
+        constexpr int numOps = 2'000'000;
+        std::signal(SIGALRM, onAlarm);
+        itimerval timer {{0, 100}, {0, 100}}; // Every 100 microseconds.
+        setitimer(ITIMER_REAL, &timer, nullptr);
+
+        // The main thread keeps allocating and freeing blocks which it checks before freeing.
+        std::array<std::pair<unsigned char*, std::size_t>, 16> blocks {};
+        int numMainCorrupted = 0;
+        for (int i = 0; i < numOps; ++i) {
+            auto& [block, size] = blocks[i % blocks.size()];
+            if (block) {
+                for (std::size_t k = 0; k < size; ++k)
+                    if (block[k] != (unsigned char)size)
+                        ++numMainCorrupted;
+                resource.deallocate(block, size);
+            }
+            size = 16 + (i % 13) * 16;
+            block = static_cast<unsigned char*>(resource.tryAllocate(size));
+            assert(block != nullptr);
+            std::memset(block, (unsigned char)size, size);
+        }
+
+        itimerval stop {};
+        setitimer(ITIMER_REAL, &stop, nullptr);
+        std::signal(SIGALRM, SIG_DFL);
+        for (auto& [block, size] : blocks)
+            resource.deallocate(block, size);
+        for (unsigned char* report : reports)
+            resource.deallocate(report, reportSize);
+        cout << "  " << numSignals << " signals handled, " << numCorrupted + numMainCorrupted << " corrupted bytes, "
+             << resource.numberOfAllocations() << " allocations and " << resource.numberOfBusyArenas() << " busy arenas left.\n";
+        assert(numCorrupted + numMainCorrupted == 0 && resource.numberOfBusyArenas() == 0);
+    }
+#endif
+
+    return 0;
+}
@@ -0,0 +1,356 @@
+#include <array>
+#include <vector>
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <set>
+
+#include <MultiArena/MultiArena.h>
+
+using std::array;
+using std::vector;
+using std::cout;
+
+int main()
+{
+    // Example 4.1: Compose arenas of different sizes into one memory resource.
+    cout << "\n*** Example 4.1 *** Tiers of small and large arenas behind one memory resource.\n";
+    {
+        using namespace MultiArena;
+        // 90% of the messages are small control messages and 10% are large payloads.
+        constexpr std::size_t numMessages = 200;
+        constexpr std::size_t smallMessageSize = 64;
+        constexpr std::size_t largeMessageSize = 200 * 1024;
+
+        // 64 arenas of 4 KiB for small messages and 8 arenas of 1 MiB for large ones.
+        using TieredResource = MultiArenaSet<Tier<64, 4096>, Tier<8, 1 << 20>>;
+        // A single pool sized for the largest tier must have as many large arenas
+        // as the tiered resource has arenas in total.
+        using FlatResource = UnsynchronizedArenaResource<TieredResource::numArenas(), 1 << 20>;
+
+        // The resources are too large for the stack so make them static.
+        static TieredResource tieredResource;
+        static FlatResource flatResource;
+
+        cout << "  Small messages go to tier " << TieredResource::tierIndex(smallMessageSize)
+             << ", large messages go to tier " << TieredResource::tierIndex(largeMessageSize) << ".\n";
+
+        auto runDemo = [&](auto* memoryResource, const char* info)
+        {
+            std::pmr::polymorphic_allocator<std::byte> allocator(memoryResource);
+            array<std::pair<std::byte*, std::size_t>, numMessages> aMessages;
+            for (std::size_t i = 0; i < numMessages; ++i) {
+                std::size_t bytes = (i % 10 == 9) ? largeMessageSize : smallMessageSize;
+                aMessages[i] = { allocator.allocate(bytes), bytes };
+            }
+            cout << "  " << info << ": " << memoryResource->numberOfAllocations() << " allocations in "
+                 << memoryResource->numberOfBusyArenas() << " busy arenas.\n";
+            for (auto [p, bytes] : aMessages)
+                allocator.deallocate(p, bytes);
+            assert(memoryResource->numberOfAllocations() == 0);
+        };
+
+        runDemo(&tieredResource, "Tiered resource");
+        runDemo(&flatResource, "Flat resource  ");
+
+        std::size_t flatBytes = std::size_t(flatResource.numArenas()) * flatResource.arenaSize();
+        cout << "  Memory reserved for arenas:\n"
+             << "    tiered resource = " << TieredResource::totalArenaBytes() << " bytes\n"
+             << "    flat resource   = " << flatBytes << " bytes\n"
+             << "    --> The tiered resource needs "
+             << int(100.0 * TieredResource::totalArenaBytes() / flatBytes + 0.5) << "% of the memory of the flat one.\n";
+    }
+
+    // Example 4.2: Route long-lived allocations to their own arenas.
+    cout << "\n*** Example 4.2 *** Keep long-lived objects from pinning arenas with lifetime classes.\n";
+    {
+        using namespace MultiArena;
+        constexpr int numFrames = 100;
+        constexpr int numObjectsPerFrame = 20;
+
+        // Each frame allocates a bunch of short-lived objects which die at the end of the frame.
+        // Every other frame also allocates a long-lived session object which lives until the end.
+        auto runDemo = [&](auto* arenaResource, std::pmr::memory_resource* sessionResource, const char* info)
+        {
+            vector<std::pmr::vector<char>> sessionObjects;
+            std::size_t maxBusyArenas = 0;
+            for (int frame = 0; frame < numFrames; ++frame) {
+                vector<std::pmr::vector<char>> frameObjects;
+                for (int i = 0; i < numObjectsPerFrame; ++i) {
+                    frameObjects.emplace_back(64, 'f', arenaResource);
+                    if (frame % 2 == 0 && i == numObjectsPerFrame / 2)
+                        sessionObjects.emplace_back(32, 's', sessionResource);
+                }
+                maxBusyArenas = std::max(maxBusyArenas, std::size_t(arenaResource->numberOfBusyArenas()));
+            }
+            cout << "  " << info << ":\n"
+                 << "    " << arenaResource->numberOfAllocations() << " long-lived objects pin "
+                 << arenaResource->numberOfBusyArenas() << " arenas after the frames are gone.\n"
+                 << "    At most " << maxBusyArenas << " arenas were busy during a frame.\n";
+        };
+
+        UnsynchronizedArenaResource<64, 1024> mixedResource;
+        runDemo(&mixedResource, &mixedResource, "Without lifetime classes");
+
+        UnsynchronizedArenaResource<64, 1024> routedResource;
+        LifetimeView sessionResource(routedResource, Lifetime::Session);
+        runDemo(&routedResource, &sessionResource, "With lifetime classes   ");
+    }
+
+    // Example 4.3: Allocate the nodes of linked lists near their predecessors.
+    cout << "\n*** Example 4.3 *** Improve locality of linked lists with allocateNear.\n";
+    {
+        using namespace MultiArena;
+        constexpr int numLists = 64;
+        constexpr int numNodesPerList = 2000;
+        constexpr int numTraversals = 50;
+        constexpr std::size_t maxTemporaries = 8;
+
+        struct Node
+        {
+            Node* next = nullptr;
+            std::size_t value = 0;
+        };
+
+        // Grow the lists in a round-robin fashion. In between, allocate and free temporary
+        // buffers of random size, so that many arenas are retired with room left in them.
+        // Returns the time it takes to traverse every list.
+        auto runDemo = [&](bool bAllocateNear, const char* info)
+        {
+            UnsynchronizedArenaResource arenaResource(8192, 4096);
+            std::srand(0x1234abcd);
+            array<Node*, numLists> aHead {}, aTail {};
+            std::deque<std::pair<void*, std::size_t>> temporaries;
+            for (int n = 0; n < numNodesPerList; ++n) {
+                for (int k = 0; k < numLists; ++k) {
+                    void* p = (bAllocateNear && aTail[k]) ?
+                                arenaResource.allocateNear(aTail[k], sizeof(Node), alignof(Node)) :
+                                arenaResource.allocate(sizeof(Node), alignof(Node));
+                    Node* pNode = ::new (p) Node{nullptr, std::size_t(n)};
+                    (aTail[k] ? aTail[k]->next : aHead[k]) = pNode;
+                    aTail[k] = pNode;
+
+                    if (std::rand() % 16 == 0) {
+                        std::size_t bytes = 256 + std::rand() % 3072;
+                        temporaries.emplace_back(arenaResource.allocate(bytes), bytes);
+                        if (temporaries.size() > maxTemporaries) {
+                            arenaResource.deallocate(temporaries.front().first, temporaries.front().second);
+                            temporaries.pop_front();
+                        }
+                    }
+                }
+            }
+
+            // Count in how many arenas the nodes of a list are scattered on average.
+            std::size_t sumArenas = 0;
+            for (Node* pNode : aHead) {
+                std::set<uintptr_t> arenas;
+                for (; pNode; pNode = pNode->next)
+                    arenas.insert(reinterpret_cast<uintptr_t>(pNode) / arenaResource.arenaSize());
+                sumArenas += arenas.size();
+            }
+
+            auto start = std::chrono::high_resolution_clock::now();
+            std::size_t sum = 0;
+            for (int round = 0; round < numTraversals; ++round)
+                for (Node* pNode : aHead)
+                    for (; pNode; pNode = pNode->next)
+                        sum += pNode->value;
+            auto end = std::chrono::high_resolution_clock::now();
+            std::chrono::duration<double> diff = end - start;
+            if (sum != std::size_t(numTraversals) * numLists * numNodesPerList * (numNodesPerList - 1) / 2)
+                throw std::runtime_error("Example 4.3: memory corruption detected!");
+
+            cout << "  " << info << ": a list spans " << double(sumArenas) / numLists << " arenas on average, "
+                 << "traversal takes " << diff.count() * 1000 << " ms.\n";
+            return diff.count();
+        };
+
+        double timeAllocate = runDemo(false, "allocate    ");
+        double timeAllocateNear = runDemo(true, "allocateNear");
+        cout << "    --> Relative traversal time: time(allocateNear) / time(allocate) = "
+             << int(100 * timeAllocateNear / timeAllocate + 0.5) << "%\n";
+    }
+
+    // Example 4.4: Tap the arenas in address order for a FIFO stream.
+    cout << "\n*** Example 4.4 *** Ring order vs LIFO order of free arenas in a FIFO stream.\n";
+    {
+        using namespace MultiArena;
+        constexpr int numBuffers = 400000;
+        constexpr std::size_t queueLength = 2000;
+
+        // Buffers of random size are written to the tail of a queue and read from its head
+        // in allocation order. Returns the time it takes to stream all buffers.
+        auto runDemo = [&](ArenaSelectionPolicy policy, const char* info)
+        {
+            UnsynchronizedArenaResource arenaResource(1024, 16 * 1024);
+            arenaResource.setArenaSelectionPolicy(policy);
+            std::srand(0x1234abcd);
+            std::deque<std::pair<std::byte*, std::size_t>> queue;
+            std::size_t sum = 0, expectedSum = 0;
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int i = 0; i < numBuffers; ++i) {
+                std::size_t bytes = 256 + 64 * (std::rand() % 64);
+                auto p = static_cast<std::byte*>(arenaResource.allocate(bytes));
+                std::fill(p, p + bytes, std::byte(i));
+                expectedSum += bytes * (i & 0xff);
+                queue.emplace_back(p, bytes);
+                if (queue.size() > queueLength) {
+                    auto [q, n] = queue.front();
+                    for (std::size_t k = 0; k < n; ++k)
+                        sum += std::size_t(q[k]);
+                    arenaResource.deallocate(q, n);
+                    queue.pop_front();
+                }
+            }
+            for (auto [q, n] : queue) {
+                for (std::size_t k = 0; k < n; ++k)
+                    sum += std::size_t(q[k]);
+                arenaResource.deallocate(q, n);
+            }
+            auto end = std::chrono::high_resolution_clock::now();
+            std::chrono::duration<double> diff = end - start;
+            if (sum != expectedSum || arenaResource.numberOfBusyArenas() != 0)
+                throw std::runtime_error("Example 4.4: memory corruption detected!");
+
+            cout << "  " << info << ": " << diff.count() * 1000 << " ms.\n";
+            return diff.count();
+        };
+
+        double timeLifo = runDemo(ArenaSelectionPolicy::Lifo, "Lifo");
+        double timeRing = runDemo(ArenaSelectionPolicy::Ring, "Ring");
+        cout << "    --> Relative time: time(ring) / time(lifo) = "
+             << int(100 * timeRing / timeLifo + 0.5) << "%\n";
+    }
+
+    // Example 4.5: Compare the arena selection policies.
+    cout << "\n*** Example 4.5 *** Throughput of the arena selection policies.\n";
+    {
+        using namespace MultiArena;
+        constexpr int numIterations = 400000;
+        constexpr std::size_t numSlots = 2000;
+
+        // Workload 1 like in example 2: replace a random vector with a new vector of random size.
+        // Workload 2 like in example 4.4: free the buffers in allocation order.
+        // Returns the number of million allocations per second.
+        auto runWorkload = [&](ArenaSelectionPolicy policy, bool bFifo)
+        {
+            UnsynchronizedArenaResource arenaResource(1024, 16 * 1024);
+            arenaResource.setArenaSelectionPolicy(policy);
+            std::srand(0x1234abcd);
+            vector<std::pair<std::byte*, std::size_t>> vecSlots(numSlots, {nullptr, 0});
+            std::size_t sum = 0;
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int i = 0; i < numIterations; ++i) {
+                auto& [p, bytes] = vecSlots[bFifo ? i % numSlots : std::rand() % numSlots];
+                if (p) {
+                    for (std::size_t k = 0; k < bytes; k += 64)
+                        sum += std::size_t(p[k]);
+                    arenaResource.deallocate(p, bytes);
+                }
+                bytes = 256 + 64 * (std::rand() % 64);
+                p = static_cast<std::byte*>(arenaResource.allocate(bytes));
+                std::fill(p, p + bytes, std::byte(1));
+            }
+            auto end = std::chrono::high_resolution_clock::now();
+            std::chrono::duration<double> diff = end - start;
+            for (auto [p, bytes] : vecSlots)
+                arenaResource.deallocate(p, bytes);
+            if (sum == 0 || arenaResource.numberOfBusyArenas() != 0)
+                throw std::runtime_error("Example 4.5: memory corruption detected!");
+            return numIterations / diff.count() / 1e6;
+        };
+
+        std::pair<ArenaSelectionPolicy, const char*> aPolicies[] = {
+            { ArenaSelectionPolicy::Lifo, "Lifo         " },
+            { ArenaSelectionPolicy::Ring, "Ring         " },
+            { ArenaSelectionPolicy::LowestAddress, "LowestAddress" } };
+        runWorkload(ArenaSelectionPolicy::Lifo, false); // Warm up.
+        cout << "  Million allocations per second:\n"
+             << "    Policy          Random order   Allocation order\n";
+        for (auto [policy, info] : aPolicies)
+            cout << "    " << info << "   " << runWorkload(policy, false) << "        " << runWorkload(policy, true) << "\n";
+    }
+
+    // Example 4.6: Let growing buffers use the slack at the end of the active arena.
+    cout << "\n*** Example 4.6 *** Grow buffers with allocateAtLeast.\n";
+    {
+        using namespace MultiArena;
+        constexpr int numBuffers = 50000;
+        constexpr std::size_t estimatedSize = 5000;
+
+        // A minimal byte buffer which starts with the estimated capacity and
+        // doubles its capacity when it runs out of room.
+        // If bAtLeast is true, the capacity is whatever allocateAtLeast returns.
+        struct GrowingBuffer
+        {
+            UnsynchronizedArenaResource<>* resource;
+            bool bAtLeast;
+            std::byte* data = nullptr;
+            std::size_t size = 0;
+            std::size_t capacity = 0;
+            std::size_t numReallocations = 0;
+
+            void push_back(std::byte b)
+            {
+                if (size == capacity) {
+                    std::size_t newCapacity = std::max(std::size_t(estimatedSize), 2 * capacity);
+                    AllocationResult result = bAtLeast ? resource->allocateAtLeast(newCapacity)
+                                                       : AllocationResult{resource->allocate(newCapacity), newCapacity};
+                    if (size)
+                        std::copy(data, data + size, static_cast<std::byte*>(result.ptr));
+                    if (data)
+                        resource->deallocate(data, capacity);
+                    data = static_cast<std::byte*>(result.ptr);
+                    capacity = result.count;
+                    ++numReallocations;
+                }
+                data[size++] = b;
+            }
+        };
+
+        // Fills buffers one after another and keeps the last few alive. The estimate is 20% off either way,
+        // so a buffer outgrows it every now and then and the reallocation would tap a new arena.
+        auto runDemo = [&](bool bAtLeast, const char* info)
+        {
+            UnsynchronizedArenaResource arenaResource(256, 16 * 1024);
+            std::srand(0x1234abcd);
+            std::deque<GrowingBuffer> buffers;
+            std::size_t numReallocations = 0, numBytes = 0;
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int i = 0; i < numBuffers; ++i) {
+                GrowingBuffer& buffer = buffers.emplace_back(GrowingBuffer{&arenaResource, bAtLeast});
+                std::size_t size = estimatedSize * 4 / 5 + std::rand() % (estimatedSize * 2 / 5);
+                for (std::size_t k = 0; k < size; ++k)
+                    buffer.push_back(std::byte(k));
+                numReallocations += buffer.numReallocations;
+                numBytes += size;
+                if (buffers.size() > 8) {
+                    arenaResource.deallocate(buffers.front().data, buffers.front().capacity);
+                    buffers.pop_front();
+                }
+            }
+            auto end = std::chrono::high_resolution_clock::now();
+            std::chrono::duration<double> diff = end - start;
+            for (auto& buffer : buffers)
+                arenaResource.deallocate(buffer.data, buffer.capacity);
+            if (arenaResource.numberOfBusyArenas() != 0)
+                throw std::runtime_error("Example 4.6: memory leak detected!");
+
+            cout << "  " << info << ": " << double(numReallocations) / numBuffers << " reallocations per buffer, "
+                 << arenaResource.numberOfArenaSwitches() << " arena switches, "
+                 << diff.count() * 1000 << " ms.\n";
+            return arenaResource.numberOfArenaSwitches();
+        };
+
+        std::size_t switchesAllocate = runDemo(false, "allocate       ");
+        std::size_t switchesAtLeast = runDemo(true, "allocateAtLeast");
+        cout << "    --> Relative arena switches: switches(allocateAtLeast) / switches(allocate) = "
+             << int(100.0 * switchesAtLeast / switchesAllocate + 0.5) << "%\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,186 @@
+#include <iostream>
+#include <deque>
+#include <coroutine>
+#include <exception>
+#include <cassert>
+#include <chrono>
+#include <memory>
+
+#include <MultiArena/Coroutine.h>
+
+using std::cout;
+
+// Fire-and-forget coroutine which starts immediately.
+struct Task
+{
+    struct promise_type
+    {
+        Task get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+// Single-threaded scheduler which runs the coroutines posted to it.
+struct Scheduler
+{
+    std::deque<std::coroutine_handle<>> ready;
+
+    void post(std::coroutine_handle<> handle) { ready.push_back(handle); }
+
+    // Awaitable which lets the other coroutines run.
+    auto yield()
+    {
+        struct Yield
+        {
+            Scheduler* scheduler;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle) { scheduler->post(handle); }
+            void await_resume() const noexcept {}
+        };
+        return Yield{this};
+    }
+
+    void run()
+    {
+        while (!ready.empty()) {
+            auto handle = ready.front();
+            ready.pop_front();
+            handle.resume();
+        }
+    }
+};
+
+// Task whose promise type derives from PromiseBase.
+struct HeapFrames {};
+
+template <class PromiseBase>
+struct BasicTask
+{
+    struct promise_type : PromiseBase
+    {
+        BasicTask get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+// Short-lived coroutine whose frame is allocated and freed on every call.
+template <class PromiseBase>
+BasicTask<PromiseBase> accumulate(long& sum, int i)
+{
+    sum += i;
+    co_return;
+}
+
+// The frame comes from the resource given after std::allocator_arg.
+// The frame is freed by the operator delete of ArenaFramePromise which matches every
+// form of its operator new, so the warning of GCC is a false positive.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+BasicTask<MultiArena::ArenaFramePromise> accumulate(std::allocator_arg_t, std::pmr::memory_resource&, long& sum, int i)
+{
+    sum += i;
+    co_return;
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+int main()
+{
+    // Example 5.1: Suspend the coroutine instead of blocking the thread when arenas run out.
+    cout << "\n*** Example 5.1 *** Asynchronous allocation on a single thread.\n";
+    {
+        using namespace MultiArena;
+        constexpr int numImages = 1000;
+        constexpr std::size_t imageSize = 3000;
+
+        SynchronizedArenaResource<8, 4096> arenaResource;
+        Scheduler scheduler;
+        int numResumes = 0;
+        AsyncArenaResource asyncResource(arenaResource, [&](std::coroutine_handle<> handle) {
+            ++numResumes;
+            scheduler.post(handle);
+        });
+        std::deque<void*> channel;
+        bool bDone = false;
+
+        // The producer makes images faster than the consumer analyzes them.
+        // Blocking the only thread when arenas run out would be a deadlock.
+        auto producer = [&]() -> Task
+        {
+            for (int i = 0; i < numImages; ++i) {
+                void* image = co_await asyncResource.allocateAsync(imageSize);
+                channel.push_back(image);
+                co_await scheduler.yield();
+            }
+            bDone = true;
+        };
+
+        int numAnalyzed = 0;
+        auto consumer = [&]() -> Task
+        {
+            while (!bDone || !channel.empty()) {
+                if (channel.empty()) {
+                    co_await scheduler.yield();
+                    continue;
+                }
+                void* image = channel.front();
+                channel.pop_front();
+                for (int i = 0; i < 3; ++i) // Analysis takes a few rounds.
+                    co_await scheduler.yield();
+                asyncResource.deallocate(image, imageSize);
+                ++numAnalyzed;
+            }
+        };
+
+        producer();
+        consumer();
+        scheduler.run();
+        cout << "  " << numAnalyzed << " of " << numImages << " images analyzed on one thread, "
+             << numResumes << " allocations were suspended until an arena was freed.\n";
+    }
+
+    // Example 5.2: Allocate coroutine frames from an arena instead of the heap.
+    cout << "\n*** Example 5.2 *** Coroutine frames from UnsynchronizedArenaResource vs. the heap.\n";
+    {
+        using namespace MultiArena;
+        constexpr int numCoroutines = 5'000'000;
+        static UnsynchronizedArenaResource<16, 64 * 1024> arenaResource;
+
+        auto runBenchmark = [&](auto tag, const char* info)
+        {
+            using PromiseBase = typename decltype(tag)::type;
+            long sum = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < numCoroutines; ++i)
+                accumulate<PromiseBase>(sum, i);
+            std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+            cout << "  " << info << ": " << elapsed.count() / numCoroutines << " ns per coroutine (sum " << sum << ").\n";
+            return elapsed.count();
+        };
+
+        double heapTime = runBenchmark(std::type_identity<HeapFrames>(), "Global heap      ");
+        double arenaTime;
+        {
+            FrameResourceScope scope(arenaResource);
+            arenaTime = runBenchmark(std::type_identity<ArenaFramePromise>(), "MultiArena frames");
+        }
+        cout << "  Arena time is " << 100.0 * arenaTime / heapTime << "% of heap time. "
+             << arenaResource.numberOfAllocations() << " frames outstanding.\n";
+
+        // The resource can also be given per coroutine.
+        long sum = 0;
+        accumulate(std::allocator_arg, arenaResource, sum, 42);
+        cout << "  Per-task resource: sum " << sum << ", " << arenaResource.numberOfAllocations() << " frames outstanding.\n";
+    }
+
+    return 0;
+}
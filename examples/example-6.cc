@@ -0,0 +1,66 @@
+#include <array>
+#include <vector>
+#include <cassert>
+#include <iostream>
+#include <chrono>
+#include <thread>
+
+// This example is compiled with MULTIARENA_PROFILE=1 (see CMakeLists.txt).
+#include <MultiArena/MultiArena.h>
+
+using std::cout;
+
+int main()
+{
+    // Example 6.1: Find out how much time the threads spend waiting for the lock of a synchronized resource.
+    cout << "\n*** Example 6.1 *** Contention profile of SynchronizedArenaResource.\n";
+#if MULTIARENA_PROFILE
+    {
+        using namespace MultiArena;
+        constexpr int numOpsPerThread = 200000;
+        SynchronizedArenaResource resource(256, 4 * 1024);
+
+        // Each thread keeps allocating small blocks and freeing them in batches.
+        auto runBenchmark = [&](std::pmr::memory_resource& mr, int numThreads)
+        {
+            auto job = [&] {
+                std::array<void*, 64> blocks;
+                for (int i = 0; i < numOpsPerThread; i += int(blocks.size())) {
+                    for (std::size_t k = 0; k < blocks.size(); ++k)
+                        blocks[k] = mr.allocate(32 + (k % 8) * 16);
+                    for (std::size_t k = 0; k < blocks.size(); ++k)
+                        mr.deallocate(blocks[k], 32 + (k % 8) * 16);
+                }
+            };
+            std::vector<std::thread> threads;
+            for (int t = 0; t < numThreads; ++t)
+                threads.emplace_back(job);
+            for (std::thread& t : threads)
+                t.join();
+        };
+
+        auto print = [](const char* name, const ContentionStatistics::LockStatistics& locks)
+        {
+            double meanWait = locks.numAcquisitions ? double(locks.totalWaitTime.count()) / locks.numAcquisitions : 0.0;
+            cout << "    " << name << locks.numAcquisitions << " acquisitions, "
+                 << std::chrono::duration<double, std::milli>(locks.totalWaitTime).count() << " ms waiting, "
+                 << meanWait << " ns per acquisition\n";
+        };
+
+        for (int numThreads : {1, 4, 16}) {
+            resource.resetContentionStatistics();
+            runBenchmark(resource, numThreads);
+            ContentionStatistics stats = resource.contentionStatistics();
+            cout << "  " << numThreads << " threads, " << stats.numFailedFits << " failed fits:\n";
+            print("shared, allocation     : ", stats.sharedLocks);
+            print("exclusive, arena switch: ", stats.switchLocks);
+            print("shared, recycle        : ", stats.recycleLocks);
+            print("exclusive, lease       : ", stats.leaseLocks);
+        }
+        assert(resource.numberOfBusyArenas() == 0);
+    }
+#else
+    cout << "  Compile with MULTIARENA_PROFILE=1 to enable the profiler.\n";
+#endif
+    return 0;
+}
@@ -0,0 +1,277 @@
+#include <array>
+#include <vector>
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include <optional>
+#include <mutex>
+#include <condition_variable>
+
+#include <MultiArena/MultiArena.h>
+
+using std::array;
+using std::vector;
+using std::cout;
+
+int main()
+{
+    // Example 7.1: Drop all per-frame allocations at once.
+    cout << "\n*** Example 7.1 *** Release everything allocated during a frame in one step.\n";
+    {
+        using namespace MultiArena;
+        constexpr int numFrames = 2000;
+        constexpr int numAllocationsPerFrame = 2000;
+
+        // Each frame allocates a bunch of blocks of random size which all die at the end of the frame.
+        // Returns the time it takes to run all frames.
+        auto runDemo = [&](bool bRelease, const char* info)
+        {
+            UnsynchronizedArenaResource<64, 16 * 1024> arenaResource;
+            std::srand(0x1234abcd);
+            array<std::size_t, numAllocationsPerFrame> aSizes;
+            for (auto& bytes : aSizes)
+                bytes = 16 + std::rand() % 256;
+            vector<std::pair<void*, std::size_t>> vecBlocks;
+            vecBlocks.reserve(numAllocationsPerFrame);
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int frame = 0; frame < numFrames; ++frame) {
+                for (std::size_t bytes : aSizes)
+                    vecBlocks.emplace_back(arenaResource.allocate(bytes), bytes);
+                if (bRelease) {
+                    arenaResource.release();
+                }
+                else {
+                    for (auto [p, bytes] : vecBlocks)
+                        arenaResource.deallocate(p, bytes);
+                }
+                vecBlocks.clear();
+            }
+            auto end = std::chrono::high_resolution_clock::now();
+            std::chrono::duration<double> diff = end - start;
+            if (arenaResource.numberOfAllocations() != 0 || arenaResource.numberOfBusyArenas() != 0)
+                throw std::runtime_error("Example 7.1: memory leak detected!");
+
+            cout << "  " << info << ": " << diff.count() * 1000 << " ms.\n";
+            return diff.count();
+        };
+
+        double timeDeallocate = runDemo(false, "Deallocate one by one");
+        double timeRelease = runDemo(true, "Release all at once  ");
+        cout << "    --> Relative time: time(release) / time(deallocate) = "
+             << int(100 * timeRelease / timeDeallocate + 0.5) << "%\n";
+    }
+
+    // Example 7.2: Roll back the scratch data of each solver step.
+    cout << "\n*** Example 7.2 *** Release scratch data of nested scopes with markers.\n";
+    {
+        using namespace MultiArena;
+        constexpr int numSteps = 1000;
+        constexpr int numIterationsPerStep = 4;
+        constexpr int numTemporariesPerIteration = 500;
+
+        // Each solver step keeps a result and allocates temporaries in nested iterations.
+        // The results are kept in arenas of their own so that they don't pin the arenas of the temporaries.
+        // Returns the time it takes to run all steps.
+        auto runDemo = [&](bool bRollback, const char* info)
+        {
+            UnsynchronizedArenaResource<256, 16 * 1024> arenaResource;
+            vector<void*> vecResults, vecTemporaries;
+            vecTemporaries.reserve(numIterationsPerStep * numTemporariesPerIteration);
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int step = 0; step < numSteps; ++step) {
+                vecResults.push_back(arenaResource.allocateFor(Lifetime::Session, 64));
+                if (bRollback) {
+                    RollbackScope stepScope(arenaResource);
+                    for (int iter = 0; iter < numIterationsPerStep; ++iter) {
+                        RollbackScope iterationScope(arenaResource);
+                        for (int i = 0; i < numTemporariesPerIteration; ++i)
+                            vecTemporaries.push_back(arenaResource.allocate(16 + 16 * (i % 8)));
+                        vecTemporaries.clear();
+                    }
+                }
+                else {
+                    for (int iter = 0; iter < numIterationsPerStep; ++iter) {
+                        for (int i = 0; i < numTemporariesPerIteration; ++i)
+                            vecTemporaries.push_back(arenaResource.allocate(16 + 16 * (i % 8)));
+                        for (int i = 0; i < numTemporariesPerIteration; ++i)
+                            arenaResource.deallocate(vecTemporaries[i], 16 + 16 * (i % 8));
+                        vecTemporaries.clear();
+                    }
+                }
+            }
+            auto end = std::chrono::high_resolution_clock::now();
+            std::chrono::duration<double> diff = end - start;
+            if (arenaResource.numberOfAllocations() != vecResults.size())
+                throw std::runtime_error("Example 7.2: memory leak detected!");
+            for (void* p : vecResults)
+                arenaResource.deallocate(p, 64);
+
+            cout << "  " << info << ": " << diff.count() * 1000 << " ms.\n";
+            return diff.count();
+        };
+
+        double timeDeallocate = runDemo(false, "Deallocate one by one");
+        double timeRollback = runDemo(true, "Roll back to markers ");
+        cout << "    --> Relative time: time(rollback) / time(deallocate) = "
+             << int(100 * timeRollback / timeDeallocate + 0.5) << "%\n";
+
+        // A marker can't be set while arenas are reserved. Otherwise ending the reservation
+        // inside the marked scope would return an arena to the free list behind the marker's
+        // back and the rollback would lose the arena for good.
+        UnsynchronizedArenaResource<8, 1024> arenaResource;
+        bool bRefused = false;
+        {
+            auto reservation = arenaResource.reserve(100, 1);
+            void* p = reservation.allocate(100);
+            if constexpr (exceptionsEnabled) {
+                try {
+                    arenaResource.mark();
+                }
+                catch (const std::logic_error&) {
+                    bRefused = true;
+                }
+            }
+            else {
+                bRefused = (arenaResource.mark().depth == 0);
+            }
+            arenaResource.deallocate(p, 100);
+        }
+        {
+            RollbackScope scope(arenaResource);
+            [[maybe_unused]] void* scratch = arenaResource.allocate(900);
+        }
+        vector<void*> blocks;
+        for (int i = 0; i < 8; ++i)
+            if (void* p = arenaResource.allocate(1024))
+                blocks.push_back(p);
+        for (void* p : blocks)
+            arenaResource.deallocate(p, 1024);
+        if (!bRefused || blocks.size() != 8)
+            throw std::runtime_error("Example 7.2: an arena was lost!");
+        cout << "  A marker is refused while a reservation is held. All " << blocks.size() << " arenas are usable afterwards.\n";
+    }
+
+    // Example 7.3: Produce frame N while frame N-1 is being analyzed.
+    cout << "\n*** Example 7.3 *** Double-buffered frames with FrameArenaResource.\n";
+    {
+        using namespace MultiArena;
+        constexpr int numFrames = 2000;
+        constexpr int numVectorsPerFrame = 32;
+        constexpr int numReplacementsPerFrame = 256;
+        constexpr std::size_t maxVectorSize = 512;
+
+        using Frame = std::pmr::vector<std::pmr::vector<int>>;
+        struct Handoff
+        {
+            Frame* frame;
+            int number;
+            std::size_t token; // Returned by retainFrame().
+        };
+
+        // Like in example 2, the vectors of a frame are replaced with new vectors of random size.
+        // The finished frame is handed over to a consumer thread which analyzes it and then
+        // drops it with dropFrame. At most one frame waits for the consumer.
+        // startFrame returns false if the producer must wait for the consumer before it
+        // can start a new frame. Returns the time it takes to run all frames.
+        auto runDemo = [&](std::pmr::memory_resource* memoryResource, auto&& retainFrame, auto&& dropFrame,
+                           auto&& startFrame, auto&& numBusyArenas, const char* info)
+        {
+            std::srand(0x1234abcd);
+            std::mutex mtx;
+            std::condition_variable cv;
+            std::optional<Handoff> pending;
+            bool bDone = false;
+            bool bCorrupted = false;
+
+            auto start = std::chrono::high_resolution_clock::now();
+            std::thread consumer([&] {
+                while (true) {
+                    std::unique_lock<std::mutex> lock(mtx);
+                    cv.wait(lock, [&] { return pending || bDone; });
+                    if (!pending)
+                        break;
+                    Handoff handoff = *pending;
+                    pending.reset();
+                    lock.unlock();
+                    cv.notify_all();
+                    for (auto& vec : *handoff.frame)
+                        for (int val : vec)
+                            if (val != handoff.number)
+                                bCorrupted = true;
+                    dropFrame(handoff);
+                }
+            });
+
+            std::size_t maxBusyArenas = 0;
+            std::size_t numStalls = 0;
+            std::pmr::polymorphic_allocator<Frame> alloc(memoryResource);
+            for (int number = 0; number < numFrames; ++number) {
+                Frame* frame = alloc.allocate(1);
+                alloc.construct(frame, numVectorsPerFrame);
+                for (int i = 0; i < numReplacementsPerFrame; ++i) {
+                    auto& vec = (*frame)[std::rand() % numVectorsPerFrame];
+                    vec = std::pmr::vector<int>(std::rand() % maxVectorSize, number, memoryResource);
+                }
+                Handoff handoff {frame, number, retainFrame()};
+                {
+                    std::unique_lock<std::mutex> lock(mtx);
+                    cv.wait(lock, [&] { return !pending; });
+                    pending = handoff;
+                }
+                cv.notify_all();
+                maxBusyArenas = std::max(maxBusyArenas, std::size_t(numBusyArenas()));
+                for (bool bStalled = false; !startFrame(); bStalled = true) {
+                    if (!bStalled)
+                        ++numStalls;
+                    std::this_thread::yield();
+                }
+            }
+            {
+                const std::lock_guard<std::mutex> lock(mtx);
+                bDone = true;
+            }
+            cv.notify_all();
+            consumer.join();
+            auto end = std::chrono::high_resolution_clock::now();
+            std::chrono::duration<double> diff = end - start;
+            if (bCorrupted)
+                throw std::runtime_error("Example 7.3: memory corruption detected!");
+
+            cout << "  " << info << ": at most " << maxBusyArenas << " busy arenas, "
+                 << numStalls << " waits for the consumer, " << diff.count() * 1000 << " ms.\n";
+            return diff.count();
+        };
+
+        // The resources are too large for the stack so make them static.
+        // The consumer destroys each frame and frees its vectors one by one.
+        static SynchronizedArenaResource<192, 16 * 1024> sharedResource;
+        double timeShared = runDemo(&sharedResource, [] { return std::size_t(0); },
+                                    [&](const Handoff& handoff) {
+                                        std::pmr::polymorphic_allocator<Frame> alloc(&sharedResource);
+                                        alloc.destroy(handoff.frame);
+                                        alloc.deallocate(handoff.frame, 1);
+                                    },
+                                    [] { return true; },
+                                    [&] { return sharedResource.numberOfBusyArenas(); },
+                                    "Frames share one pool   ");
+
+        // The frames are never destroyed. The consumer releases its frame and the producer
+        // drops the pool of the frame all at once when it reuses the pool.
+        // There are three pools for the frame being produced, the waiting one and the analyzed one.
+        static FrameArenaResource<UnsynchronizedArenaResource<64, 16 * 1024>, 3> frameResource;
+        double timeFrames = runDemo(&frameResource, [&] { return frameResource.retainFrame(); },
+                                    [&](const Handoff& handoff) { frameResource.releaseFrame(handoff.token); },
+                                    [&] { return frameResource.nextFrame(); },
+                                    [&] { return frameResource.pool(0).numberOfBusyArenas() +
+                                                 frameResource.pool(1).numberOfBusyArenas() +
+                                                 frameResource.pool(2).numberOfBusyArenas(); },
+                                    "Each frame has its pool ");
+        cout << "    --> Relative time: time(frame pools) / time(shared pool) = "
+             << int(100 * timeFrames / timeShared + 0.5) << "%\n";
+    }
+
+    return 0;
+}
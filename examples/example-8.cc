@@ -0,0 +1,241 @@
+#include <array>
+#include <vector>
+#include <cassert>
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <MultiArena/MultiArena.h>
+
+using std::array;
+using std::cout;
+
+int main()
+{
+    // Example 8.1: Reserve the space for a burst of allocations at the top of each frame.
+    cout << "\n*** Example 8.1 *** Reserve capacity so that a burst never fails midway.\n";
+    {
+        using namespace MultiArena;
+        constexpr int numFrames = 100000;
+        constexpr std::size_t numAllocationsPerFrame = 40;
+        constexpr std::size_t messageSize = 200;
+
+        SynchronizedArenaResource<64, 4096> arenaResource;
+        std::srand(0x1234abcd);
+        std::deque<void*> backgroundBlocks; // Allocations which compete for the arenas.
+        int numFramesDone = 0, numFramesSkipped = 0;
+        double timeInReserve = 0;
+        for (int frame = 0; frame < numFrames; ++frame) {
+            // The background load varies from frame to frame.
+            std::size_t numBackgroundBlocks = std::rand() % 200;
+            while (backgroundBlocks.size() < numBackgroundBlocks) {
+                try {
+                    backgroundBlocks.push_back(arenaResource.allocate(1024));
+                }
+                catch (OutOfFreeArenas&) {
+                    break;
+                }
+            }
+            while (backgroundBlocks.size() > numBackgroundBlocks) {
+                arenaResource.deallocate(backgroundBlocks.front(), 1024);
+                backgroundBlocks.pop_front();
+            }
+
+            // Either the whole frame can be built or it is skipped before anything is done.
+            auto start = std::chrono::high_resolution_clock::now();
+            auto reservation = arenaResource.reserve(messageSize, numAllocationsPerFrame);
+            auto end = std::chrono::high_resolution_clock::now();
+            timeInReserve += std::chrono::duration<double>(end - start).count();
+            if (!reservation.valid()) {
+                ++numFramesSkipped;
+                continue;
+            }
+            array<void*, numAllocationsPerFrame> aMessages;
+            for (auto& p : aMessages)
+                p = reservation.allocate(messageSize);  // Never throws.
+            for (auto p : aMessages)
+                reservation.deallocate(p, messageSize);
+            ++numFramesDone;
+        }
+        for (void* p : backgroundBlocks)
+            arenaResource.deallocate(p, 1024);
+        if (arenaResource.numberOfBusyArenas() != 0 || arenaResource.numberOfReservedArenas() != 0)
+            throw std::runtime_error("Example 8.1: memory leak detected!");
+
+        cout << "  " << numFramesDone << " frames were built and " << numFramesSkipped
+             << " frames were skipped because the reservation failed.\n"
+             << "  A reservation takes " << timeInReserve / numFrames * 1e9 << " ns on average.\n";
+    }
+
+    // Example 8.2: Keep arenas in reserve for the control path.
+    cout << "\n*** Example 8.2 *** Priority classes and reserve arenas under overload.\n";
+    {
+        using namespace MultiArena;
+        constexpr int numRounds = 10000;
+
+        // Telemetry allocates faster than it is drained so the resource runs out of arenas
+        // every now and then. The control path makes a few short-lived allocations in each round.
+        auto runDemo = [&](SizeType numHighPriorityArenas, const char* info)
+        {
+            UnsynchronizedArenaResource<32, 4096> arenaResource;
+            arenaResource.setReserveArenas(numHighPriorityArenas, 0);
+            PriorityView controlResource(arenaResource, Priority::High);
+            std::srand(0x1234abcd);
+            std::deque<void*> telemetry;
+            int numTelemetryFailures = 0, numControlFailures = 0;
+            for (int round = 0; round < numRounds; ++round) {
+                for (int i = 0; i < 10; ++i) {
+                    try {
+                        telemetry.push_back(arenaResource.allocate(256));
+                    }
+                    catch (OutOfFreeArenas&) {
+                        ++numTelemetryFailures;
+                    }
+                }
+                for (int i = std::rand() % 20; i > 0 && !telemetry.empty(); --i) {
+                    arenaResource.deallocate(telemetry.front(), 256);
+                    telemetry.pop_front();
+                }
+                try {
+                    std::pmr::vector<char> command(1000, 'c', &controlResource);
+                }
+                catch (OutOfFreeArenas&) {
+                    ++numControlFailures;
+                }
+                // The telemetry must never hold the reserve arenas.
+                assert(arenaResource.numberOfBusyArenas() + numHighPriorityArenas <= 32);
+            }
+            for (void* p : telemetry)
+                arenaResource.deallocate(p, 256);
+
+            cout << "  " << info << ": " << numTelemetryFailures << " telemetry and "
+                 << numControlFailures << " control path allocations failed, "
+                 << arenaResource.numberOfReserveTaps(Priority::High) << " reserve arenas tapped.\n";
+        };
+
+        runDemo(0, "No reserve      ");
+        runDemo(2, "2 reserve arenas");
+    }
+
+    // Example 8.3: Flush a cache when the resource runs out of arenas.
+    cout << "\n*** Example 8.3 *** Retry failed allocations after an out-of-arenas handler.\n";
+    {
+        using namespace MultiArena;
+        constexpr int numRequests = 100000;
+
+        // A cache of results which would otherwise grow until the resource runs out of arenas.
+        struct Cache
+        {
+            UnsynchronizedArenaResource<>* resource;
+            std::deque<void*> entries;
+
+            // Evicts the older half of the cache. Returns false if there is nothing to evict.
+            static bool flush(std::size_t /*bytes*/, void* context)
+            {
+                auto* cache = static_cast<Cache*>(context);
+                if (cache->entries.empty())
+                    return false;
+                for (std::size_t n = (cache->entries.size() + 1) / 2; n > 0; --n) {
+                    cache->resource->deallocate(cache->entries.front(), 512);
+                    cache->entries.pop_front();
+                }
+                return true;
+            }
+        };
+
+        auto runDemo = [&](bool bHandler, const char* info)
+        {
+            UnsynchronizedArenaResource arenaResource(64, 4096);
+            Cache cache{&arenaResource, {}};
+            if (bHandler)
+                arenaResource.setOutOfArenasHandler(&Cache::flush, &cache);
+            int numFailures = 0;
+            for (int i = 0; i < numRequests; ++i) {
+                try {
+                    cache.entries.push_back(arenaResource.allocate(512));
+                }
+                catch (OutOfFreeArenas&) {
+                    ++numFailures;
+                }
+            }
+            cout << "  " << info << ": " << numFailures << " of " << numRequests << " allocations failed.\n";
+        };
+
+        runDemo(false, "Without handler");
+        runDemo(true, "With handler   ");
+    }
+
+    // Example 8.4: The producer waits for the consumers to free arenas.
+    cout << "\n*** Example 8.4 *** Producer/consumer pipeline with blocking allocation.\n";
+    {
+        using namespace MultiArena;
+        constexpr int numImages = 2000;
+        constexpr std::size_t imageSize = 3000;
+
+        auto runDemo = [&](bool bWait, const char* info)
+        {
+            SynchronizedArenaResource<8, 4096> arenaResource;
+            std::deque<void*> queue;
+            std::mutex mtx;
+            std::condition_variable cv;
+            bool bDone = false;
+
+            // The consumers analyze the images slower than the producer makes them.
+            auto consumer = [&]()
+            {
+                for (;;) {
+                    void* image;
+                    {
+                        std::unique_lock<std::mutex> lock(mtx);
+                        cv.wait(lock, [&] { return bDone || !queue.empty(); });
+                        if (queue.empty())
+                            return;
+                        image = queue.front();
+                        queue.pop_front();
+                    }
+                    std::this_thread::sleep_for(std::chrono::microseconds(50));
+                    arenaResource.deallocate(image, imageSize);
+                }
+            };
+            std::thread consumers[2] = {std::thread(consumer), std::thread(consumer)};
+
+            int numDropped = 0;
+            for (int i = 0; i < numImages; ++i) {
+                try {
+                    void* image = bWait ? arenaResource.allocateWait(imageSize, alignof(std::max_align_t), std::chrono::seconds(1))
+                                        : arenaResource.allocate(imageSize);
+                    {
+                        const std::lock_guard<std::mutex> lock(mtx);
+                        queue.push_back(image);
+                    }
+                    cv.notify_one();
+                }
+                catch (OutOfFreeArenas&) {
+                    ++numDropped;
+                }
+            }
+            {
+                const std::lock_guard<std::mutex> lock(mtx);
+                bDone = true;
+            }
+            cv.notify_all();
+            for (std::thread& t : consumers)
+                t.join();
+
+            auto stats = arenaResource.waitStatistics();
+            cout << "  " << info << ": " << numDropped << " of " << numImages << " images dropped, "
+                 << stats.numWaits << " waits, " << stats.numTimeouts << " timeouts, mean wait "
+                 << (stats.numWaits ? stats.totalWaitTime.count() / 1000 / stats.numWaits : 0) << " us, max wait "
+                 << stats.maxWaitTime.count() / 1000 << " us.\n";
+        };
+
+        runDemo(false, "allocate    ");
+        runDemo(true,  "allocateWait");
+    }
+
+    return 0;
+}
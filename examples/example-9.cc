@@ -0,0 +1,289 @@
+#include <array>
+#include <vector>
+#include <numeric>
+#include <cassert>
+#include <iostream>
+#include <chrono>
+#include <thread>
+
+#include <MultiArena/MultiArena.h>
+#include <MultiArena/ArenaThreadPool.h>
+
+using std::array;
+using std::vector;
+using std::cout;
+
+int main()
+{
+    // Example 9.1: Lease arenas for batches of allocations made by one thread.
+    cout << "\n*** Example 9.1 *** Allocate batches from exclusive arena leases of a synchronized resource.\n";
+    {
+        using namespace MultiArena;
+        constexpr int numThreads = 4;
+        constexpr int numBatches = 2000;
+        constexpr int numAllocationsPerBatch = 200;
+        constexpr std::size_t blockSize = 32;
+
+        // Each thread allocates a batch of small blocks and then frees them all.
+        // Returns the time it takes to run all threads.
+        auto runDemo = [&](bool bLease, const char* info)
+        {
+            SynchronizedArenaResource<64, 64 * 1024> arenaResource;
+            auto worker = [&]()
+            {
+                array<void*, numAllocationsPerBatch> aBlocks;
+                for (int batch = 0; batch < numBatches; ++batch) {
+                    if (bLease) {
+                        auto lease = arenaResource.leaseArena();
+                        for (auto& p : aBlocks)
+                            p = lease.allocate(blockSize);
+                        for (auto p : aBlocks)
+                            lease.deallocate(p, blockSize);
+                    }
+                    else {
+                        for (auto& p : aBlocks)
+                            p = arenaResource.allocate(blockSize);
+                        for (auto p : aBlocks)
+                            arenaResource.deallocate(p, blockSize);
+                    }
+                }
+            };
+
+            auto start = std::chrono::high_resolution_clock::now();
+            vector<std::thread> vecThreads;
+            for (int i = 0; i < numThreads; ++i)
+                vecThreads.emplace_back(worker);
+            for (auto& t : vecThreads)
+                t.join();
+            auto end = std::chrono::high_resolution_clock::now();
+            std::chrono::duration<double> diff = end - start;
+            if (arenaResource.numberOfAllocations() != 0 || arenaResource.numberOfBusyArenas() != 0)
+                throw std::runtime_error("Example 9.1: memory leak detected!");
+
+            cout << "  " << info << ": " << diff.count() * 1000 << " ms.\n";
+            return diff.count();
+        };
+
+        double timeShared = runDemo(false, "Shared resource");
+        double timeLease = runDemo(true, "Arena leases   ");
+        cout << "    --> Relative time: time(leases) / time(shared) = "
+             << int(100 * timeLease / timeShared + 0.5) << "%\n";
+    }
+
+    // Example 9.2: Each worker of a thread pool allocates from its own arenas.
+    cout << "\n*** Example 9.2 *** Thread pool with per-worker arenas vs. a shared synchronized resource.\n";
+    {
+        using namespace MultiArena;
+        constexpr unsigned numWorkers = 4;
+        constexpr std::size_t numItems = 200000;
+        constexpr std::size_t numJobs = 64;
+        constexpr int numIterationsPerJob = 20000;
+        static SynchronizedArenaResource<numWorkers * 16, 64 * 1024> sharedResource;
+        ArenaThreadPool pool(numWorkers, 16, 64 * 1024);
+
+        // Parallel-for where each item needs a scratch buffer.
+        auto scratchWorkload = [&](auto getResource)
+        {
+            std::atomic<long> total {0};
+            pool.parallelFor(0, numItems, [&](std::size_t i) {
+                std::pmr::vector<int> scratch(16 + i % 500, &*getResource());
+                std::iota(scratch.begin(), scratch.end(), int(i));
+                total.fetch_add(scratch.back(), std::memory_order_relaxed);
+            });
+            return total.load();
+        };
+
+        // The workload of example-2: keep replacing random vectors in an array.
+        auto vectorWorkload = [&](auto getResource)
+        {
+            std::atomic<long> total {0};
+            pool.parallelFor(0, numJobs, [&](std::size_t job) {
+                std::pmr::vector<std::pmr::vector<int>> aVec(16, getResource());
+                uint32_t rnd = uint32_t(job) * 2654435761u + 1;
+                for (int i = 0; i < numIterationsPerJob; ++i) {
+                    rnd = rnd * 1664525u + 1013904223u;
+                    auto& vec = aVec[(rnd >> 8) % aVec.size()];
+                    vec = std::pmr::vector<int>(getResource());
+                    vec.resize((rnd >> 16) % 256);
+                    std::iota(vec.begin(), vec.end(), 0);
+                }
+                long sum = 0;
+                for (auto& vec : aVec)
+                    sum += long(vec.size());
+                total.fetch_add(sum, std::memory_order_relaxed);
+            });
+            return total.load();
+        };
+
+        auto timeIt = [](auto&& workload, auto getResource)
+        {
+            auto start = std::chrono::steady_clock::now();
+            long checksum = workload(getResource);
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            return std::make_pair(elapsed.count(), checksum);
+        };
+
+        auto shared = [&]() -> std::pmr::memory_resource* { return &sharedResource; };
+        auto perWorker = []() { return ArenaThreadPool::current(); };
+        for (int w = 0; w < 2; ++w) {
+            const char* name = (w == 0) ? "Parallel-for with scratch" : "Example-2 workload       ";
+            auto [sharedTime, sharedSum] = (w == 0) ? timeIt(scratchWorkload, shared) : timeIt(vectorWorkload, shared);
+            auto [workerTime, workerSum] = (w == 0) ? timeIt(scratchWorkload, perWorker) : timeIt(vectorWorkload, perWorker);
+            cout << "  " << name << ": shared synchronized " << sharedTime << " ms, per-worker " << workerTime
+                 << " ms (" << 100.0 * workerTime / sharedTime << "%)" << (sharedSum == workerSum ? "" : " MISMATCH") << "\n";
+        }
+    }
+
+    // Example 9.3: Free blocks owned by another thread.
+    cout << "\n*** Example 9.3 *** Cross-thread frees into a synchronized vs. an owned resource.\n";
+    {
+        using namespace MultiArena;
+        constexpr int numRounds = 200;
+        constexpr int numBlocks = 2000;
+        constexpr std::size_t blockSize = 64;
+
+        // The owner thread allocates a batch of blocks and another thread frees them.
+        // Returns the time per free and the time per block for the owner to take the block back.
+        auto runBenchmark = [&](auto& resource, auto reclaim)
+        {
+            std::vector<void*> blocks(numBlocks);
+            double freeTime = 0, reclaimTime = 0;
+            for (int round = 0; round < numRounds; ++round) {
+                for (void*& p : blocks)
+                    p = resource.allocate(blockSize);
+                std::thread freeer([&] {
+                    auto start = std::chrono::steady_clock::now();
+                    for (void* p : blocks)
+                        resource.deallocate(p, blockSize);
+                    freeTime += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+                });
+                freeer.join();
+                auto start = std::chrono::steady_clock::now();
+                reclaim();
+                reclaimTime += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            }
+            return std::make_pair(freeTime / (numRounds * numBlocks), reclaimTime / (numRounds * numBlocks));
+        };
+
+        static SynchronizedArenaResource<64, 4096> syncResource;
+        static OwnedArenaResource<64, 4096> ownedResource;
+        auto [syncFree, syncReclaim] = runBenchmark(syncResource, [] {});
+        auto [ownedFree, ownedReclaim] = runBenchmark(ownedResource, [&] { ownedResource.drainRemoteFrees(); });
+        cout << "  SynchronizedArenaResource: " << syncFree << " ns per cross-thread free.\n";
+        cout << "  OwnedArenaResource       : " << ownedFree << " ns per cross-thread free + "
+             << ownedReclaim << " ns per block drained by the owner.\n";
+    }
+
+    // Example 9.4: One thread allocates and the others free.
+    cout << "\n*** Example 9.4 *** Single producer and three consumers.\n";
+    {
+        using namespace MultiArena;
+        constexpr int numBlocks = 1000000;
+        constexpr int numConsumers = 3;
+
+        // Single producer single consumer ring of blocks.
+        struct Ring
+        {
+            std::array<void*, 1024> slots;
+            alignas(64) std::atomic<std::size_t> head {0};
+            alignas(64) std::atomic<std::size_t> tail {0};
+        };
+
+        auto runBenchmark = [&](auto& resource)
+        {
+            std::array<Ring, numConsumers> rings;
+            std::atomic<bool> bDone {false};
+            std::atomic<long> checksum {0};
+            auto consumer = [&](Ring& ring)
+            {
+                long sum = 0;
+                for (std::size_t head = 0; ; ++head) {
+                    while (head == ring.tail.load(std::memory_order_acquire)) {
+                        if (bDone.load() && head == ring.tail.load(std::memory_order_acquire)) {
+                            checksum += sum;
+                            return;
+                        }
+                        std::this_thread::yield();
+                    }
+                    auto* block = static_cast<int*>(ring.slots[head % ring.slots.size()]);
+                    sum += block[0];
+                    resource.deallocate(block, 0);
+                    ring.head.store(head + 1, std::memory_order_release);
+                }
+            };
+            auto start = std::chrono::steady_clock::now();
+            std::vector<std::thread> consumers;
+            for (Ring& ring : rings)
+                consumers.emplace_back(consumer, std::ref(ring));
+            for (int i = 0; i < numBlocks; ++i) {
+                Ring& ring = rings[i % numConsumers];
+                std::size_t tail = ring.tail.load(std::memory_order_relaxed);
+                while (tail - ring.head.load(std::memory_order_acquire) == ring.slots.size())
+                    std::this_thread::yield();
+                auto* block = static_cast<int*>(resource.allocate(32 + (i % 16) * 32));
+                block[0] = i & 0xff;
+                ring.slots[tail % ring.slots.size()] = block;
+                ring.tail.store(tail + 1, std::memory_order_release);
+            }
+            bDone = true;
+            for (std::thread& t : consumers)
+                t.join();
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            return std::make_pair(elapsed.count(), checksum.load());
+        };
+
+        static SynchronizedArenaResource<64, 64 * 1024> syncResource;
+        static SingleProducerArenaResource<64, 64 * 1024> singleProducerResource;
+        auto [syncTime, syncSum] = runBenchmark(syncResource);
+        auto [spTime, spSum] = runBenchmark(singleProducerResource);
+        cout << "  SynchronizedArenaResource  : " << syncTime << " ms\n";
+        cout << "  SingleProducerArenaResource: " << spTime << " ms (" << 100.0 * spTime / syncTime << "%)"
+             << (syncSum == spSum ? "" : " MISMATCH") << "\n";
+    }
+
+    // Example 9.5: Allocate small blocks through per-thread allocation buffers.
+    cout << "\n*** Example 9.5 *** Thread allocation buffers vs. allocating directly from a synchronized resource.\n";
+    {
+        using namespace MultiArena;
+        constexpr int numOpsPerThread = 400000;
+        SynchronizedArenaResource resource(256, 64 * 1024);
+
+        // Each thread allocates small blocks and frees them in batches.
+        // Returns million allocations per second and the number of slices claimed.
+        auto runBenchmark = [&](int numThreads, bool bUseBuffer)
+        {
+            std::atomic<std::size_t> numSlices = 0;
+            auto job = [&] {
+                auto buffer = resource.threadAllocationBuffer(4096);
+                std::pmr::memory_resource& mr = bUseBuffer ? static_cast<std::pmr::memory_resource&>(buffer) : resource;
+                std::array<void*, 64> blocks;
+                for (int i = 0; i < numOpsPerThread; i += int(blocks.size())) {
+                    for (std::size_t k = 0; k < blocks.size(); ++k)
+                        blocks[k] = mr.allocate(16 + (k % 4) * 16);
+                    for (std::size_t k = 0; k < blocks.size(); ++k)
+                        mr.deallocate(blocks[k], 16 + (k % 4) * 16);
+                }
+                numSlices += buffer.numberOfSlices();
+            };
+            auto start = std::chrono::steady_clock::now();
+            std::vector<std::thread> threads;
+            for (int t = 0; t < numThreads; ++t)
+                threads.emplace_back(job);
+            for (std::thread& t : threads)
+                t.join();
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            return std::make_pair(numThreads * numOpsPerThread / elapsed.count() / 1000.0, numSlices.load());
+        };
+
+        cout << "  Million allocations per second:\n";
+        for (int numThreads : {1, 2, 4, 8}) {
+            auto [directRate, unused] = runBenchmark(numThreads, false);
+            auto [bufferRate, numSlices] = runBenchmark(numThreads, true);
+            cout << "  " << numThreads << " threads: direct " << directRate << ", buffered " << bufferRate
+                 << " (one slice per " << double(numThreads) * numOpsPerThread / numSlices << " allocations)\n";
+        }
+        assert(resource.numberOfAllocations() == 0 && resource.numberOfBusyArenas() == 0);
+    }
+
+    return 0;
+}
@@ -0,0 +1,170 @@
+#ifndef MULTIARENA_ARENATHREADPOOL_H
+#define MULTIARENA_ARENATHREADPOOL_H
+
+/*
+ * ArenaThreadPool is a small thread pool where each worker thread owns
+ * an OwnedArenaResource. A task gets the resource of the worker
+ * which runs it with ArenaThreadPool::current(), so the arenas of a worker
+ * are used by one thread only and the allocations need no locks.
+ *
+ * Memory allocated by a worker may be freed by any thread. The frees made
+ * by other threads are pushed to the lock-free remote-free list of the
+ * OwnedArenaResource of the worker, which returns them to its arenas between
+ * tasks and before it allocates.
+ */
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include <MultiArena/MultiArena.h>
+
+namespace MultiArena
+{
+
+class ArenaThreadPool
+{
+public:
+    // Memory resource owned by one worker thread. Only the owner may allocate
+    // but any thread may deallocate. See OwnedArenaResource.
+    using WorkerArenaResource = OwnedArenaResource<>;
+
+    // Starts numWorkers threads, each owning numArenas arenas of arenaSize bytes.
+    ArenaThreadPool(unsigned numWorkers, SizeType numArenas, SizeType arenaSize,
+                    std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+    {
+        MULTIARENA_ASSERT(numWorkers > 0);
+        for (unsigned i = 0; i < numWorkers; ++i)
+            _workers.push_back(std::make_unique<Worker>(numArenas, arenaSize, upstream));
+        for (auto& worker : _workers)
+            worker->thread = std::thread(&ArenaThreadPool::run, this, worker.get());
+    }
+
+    // Waits until the tasks posted so far are done and stops the workers.
+    ~ArenaThreadPool()
+    {
+        wait();
+        for (auto& worker : _workers) {
+            {
+                const std::lock_guard<std::mutex> lock(worker->mtx);
+                worker->bStop = true;
+            }
+            worker->cv.notify_one();
+        }
+        for (auto& worker : _workers)
+            worker->thread.join();
+    }
+
+    ArenaThreadPool(const ArenaThreadPool&) = delete;
+    ArenaThreadPool& operator=(const ArenaThreadPool&) = delete;
+
+    unsigned numWorkers() const { return unsigned(_workers.size()); }
+
+    // The resource of the worker which runs the calling task or the default
+    // resource if the caller is not a worker thread.
+    static std::pmr::memory_resource* current()
+    {
+        return _current ? static_cast<std::pmr::memory_resource*>(_current) : std::pmr::get_default_resource();
+    }
+
+    // The resource owned by the given worker. Only the worker may allocate from it.
+    WorkerArenaResource& resourceOf(unsigned worker) { return _workers[worker]->resource; }
+
+    // Runs the task on the next worker in turn.
+    void post(std::function<void()> task)
+    {
+        Worker& worker = *_workers[_nextWorker.fetch_add(1, std::memory_order_relaxed) % _workers.size()];
+        _numPending.fetch_add(1, std::memory_order_relaxed);
+        {
+            const std::lock_guard<std::mutex> lock(worker.mtx);
+            worker.tasks.push_back(std::move(task));
+        }
+        worker.cv.notify_one();
+    }
+
+    // Waits until all posted tasks are done. Must not be called by a worker.
+    void wait()
+    {
+        MULTIARENA_ASSERT(_current == nullptr);
+        std::unique_lock<std::mutex> lock(_mtxDone);
+        _cvDone.wait(lock, [this] { return _numPending.load(std::memory_order_acquire) == 0; });
+    }
+
+    // Calls func(i) for each i in [begin, end) so that each worker gets one contiguous
+    // chunk and waits until all calls are done. Must not be called by a worker.
+    template <class Func>
+    void parallelFor(std::size_t begin, std::size_t end, Func func)
+    {
+        if (begin >= end)
+            return;
+        std::size_t numChunks = std::min<std::size_t>(_workers.size(), end - begin);
+        std::size_t chunkSize = (end - begin + numChunks - 1) / numChunks;
+        for (std::size_t chunkBegin = begin; chunkBegin < end; chunkBegin += chunkSize) {
+            std::size_t chunkEnd = std::min(chunkBegin + chunkSize, end);
+            post([&func, chunkBegin, chunkEnd] {
+                for (std::size_t i = chunkBegin; i < chunkEnd; ++i)
+                    func(i);
+            });
+        }
+        wait();
+    }
+
+private:
+    struct Worker
+    {
+        Worker(SizeType numArenas, SizeType arenaSize, std::pmr::memory_resource* upstream) :
+            resource(numArenas, arenaSize, upstream)
+        { }
+
+        WorkerArenaResource resource;
+        std::thread thread;
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::deque<std::function<void()>> tasks;
+        bool bStop = false;
+    };
+
+    void run(Worker* worker)
+    {
+        worker->resource.setOwner();
+        _current = &worker->resource;
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(worker->mtx);
+                if (worker->tasks.empty())
+                    worker->resource.drainRemoteFrees(); // Tidy up while idle.
+                worker->cv.wait(lock, [worker] { return worker->bStop || !worker->tasks.empty(); });
+                if (worker->tasks.empty())
+                    break;
+                task = std::move(worker->tasks.front());
+                worker->tasks.pop_front();
+            }
+            task();
+            task = nullptr; // Free the captures on the worker thread.
+            worker->resource.drainRemoteFrees();
+            if (_numPending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                const std::lock_guard<std::mutex> lock(_mtxDone);
+                _cvDone.notify_all();
+            }
+        }
+        _current = nullptr;
+    }
+
+    static inline thread_local WorkerArenaResource* _current = nullptr;
+
+    std::vector<std::unique_ptr<Worker>> _workers;
+    std::atomic<std::size_t> _nextWorker {0};
+    std::atomic<std::size_t> _numPending {0}; // Number of posted tasks which are not done yet.
+    std::mutex _mtxDone;
+    std::condition_variable _cvDone;
+};
+
+} // namespace MultiArena
+
+#endif // MULTIARENA_ARENATHREADPOOL_H
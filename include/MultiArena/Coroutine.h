@@ -0,0 +1,285 @@
+#ifndef MULTIARENA_COROUTINE_H
+#define MULTIARENA_COROUTINE_H
+
+/*
+ * Optional C++20 extensions of MultiArena for coroutines.
+ * The core header MultiArena.h requires only C++17.
+ *
+ * AsyncArenaResource is a memory resource which wraps a synchronized
+ * MultiArena resource. Its allocateAsync returns an awaitable which
+ * suspends the coroutine if the resource is out of free arenas instead
+ * of blocking the thread. The coroutine is resumed on the given executor
+ * as soon as a deallocation makes enough room. AsyncArenaResource installs
+ * the arena released handler of the wrapped resource, so the deallocations
+ * may be made either through AsyncArenaResource or directly on the resource.
+ * Only one AsyncArenaResource may wrap a resource at a time.
+ *
+ * ArenaFramePromise is a base class for promise types which allocates
+ * the coroutine frames from a memory resource instead of the heap.
+ * The resource is either passed to the coroutine as an argument after
+ * std::allocator_arg or set for the calling thread with FrameResourceScope.
+ */
+
+#include <coroutine>
+#include <functional>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <memory_resource>
+#include <cstring>
+
+#include <MultiArena/MultiArena.h>
+
+namespace MultiArena
+{
+
+template <class Resource>
+class AsyncArenaResource : public std::pmr::memory_resource
+{
+public:
+    // Resumes a coroutine, e.g. by posting it to a thread pool.
+    // It is called by the thread which makes the deallocation.
+    using Executor = std::function<void(std::coroutine_handle<>)>;
+
+    AsyncArenaResource(Resource& resource, Executor executor) :
+        _resource(&resource), _executor(std::move(executor))
+    {
+        _resource->setArenaReleasedHandler(&AsyncArenaResource::arenaReleased, this);
+    }
+
+    ~AsyncArenaResource()
+    {
+        _resource->setArenaReleasedHandler(nullptr);
+    }
+
+    // Awaitable returned by allocateAsync. The result of co_await is the pointer to the block.
+    class Allocation
+    {
+    public:
+        bool await_ready()
+        {
+            _result = _owner->_resource->tryAllocate(_bytes);
+            return _result != nullptr;
+        }
+
+        // Returns false if the allocation succeeded after all so that the coroutine is not suspended.
+        bool await_suspend(std::coroutine_handle<> handle)
+        {
+            _handle = handle;
+            return _owner->enqueue(this);
+        }
+
+        void* await_resume() const { return _result; }
+
+    private:
+        friend class AsyncArenaResource;
+        Allocation(AsyncArenaResource* owner, std::size_t bytes) : _owner(owner), _bytes(bytes)
+        { }
+
+        AsyncArenaResource* _owner;
+        std::size_t _bytes;
+        void* _result = nullptr;
+        std::coroutine_handle<> _handle;
+        Allocation* _next = nullptr; // Next waiter in the queue.
+    };
+
+    // Allocates bytes aligned to alignof(max_align_t). If the resource is out of free arenas,
+    // co_await suspends the calling coroutine until a deallocation makes room.
+    //   void* p = co_await asyncResource.allocateAsync(1000);
+    // Throws AllocateTooLargeBlock if the block would not fit in an arena.
+    Allocation allocateAsync(std::size_t bytes)
+    {
+        if constexpr (exceptionsEnabled) {
+            if (bytes > _resource->arenaSize())
+                throw AllocateTooLargeBlock(bytes, _resource->arenaSize());
+        }
+        return Allocation(this, bytes);
+    }
+
+    Resource* resource() const { return _resource; }
+
+    // Number of coroutines waiting for memory.
+    std::size_t numberOfWaiters() const { return _numWaiters.load(); }
+
+protected:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        return _resource->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override
+    {
+        _resource->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return (this == &other);
+    }
+
+private:
+    // The arena released handler of the resource. It is called by the thread
+    // which made the deallocation after the resource has released its locks.
+    static void arenaReleased(void* context)
+    {
+        auto* self = static_cast<AsyncArenaResource*>(context);
+        if (self->_numWaiters.load() > 0)
+            self->resumeWaiters();
+    }
+
+    // Puts the awaiter in the queue unless the allocation succeeds now.
+    // The retry is made after the waiter count has been incremented so
+    // that a concurrent release of an arena either makes room for the retry
+    // or sees the waiter.
+    bool enqueue(Allocation* waiter)
+    {
+        const std::lock_guard<std::mutex> lock(_mtx);
+        ++_numWaiters;
+        if (_head == nullptr)
+            waiter->_result = _resource->tryAllocate(waiter->_bytes);
+        if (waiter->_result != nullptr) {
+            --_numWaiters;
+            return false;
+        }
+        if (_tail)
+            _tail->_next = waiter;
+        else
+            _head = waiter;
+        _tail = waiter;
+        return true;
+    }
+
+    // Satisfies the waiters in FIFO order as long as there is room
+    // and hands them to the executor.
+    void resumeWaiters()
+    {
+        Allocation* ready = nullptr;
+        Allocation* readyTail = nullptr;
+        {
+            const std::lock_guard<std::mutex> lock(_mtx);
+            while (_head != nullptr) {
+                _head->_result = _resource->tryAllocate(_head->_bytes);
+                if (_head->_result == nullptr)
+                    break;
+                Allocation* waiter = _head;
+                _head = waiter->_next;
+                if (_head == nullptr)
+                    _tail = nullptr;
+                waiter->_next = nullptr;
+                (readyTail ? readyTail->_next : ready) = waiter;
+                readyTail = waiter;
+                --_numWaiters;
+            }
+        }
+        // The executor is called without holding the lock.
+        while (ready != nullptr) {
+            Allocation* waiter = ready;
+            ready = waiter->_next;
+            _executor(waiter->_handle);
+        }
+    }
+
+    Resource* _resource;
+    Executor _executor;
+    std::mutex _mtx;
+    std::atomic<std::size_t> _numWaiters {0};
+    Allocation* _head = nullptr; // Queue of suspended allocations.
+    Allocation* _tail = nullptr;
+};
+
+// Sets the memory resource from which the coroutine frames created by the
+// calling thread are allocated for the lifetime of the scope.
+//   MultiArena::FrameResourceScope scope(arenaResource);
+class FrameResourceScope
+{
+public:
+    explicit FrameResourceScope(std::pmr::memory_resource& resource) : _previous(_current)
+    {
+        _current = &resource;
+    }
+
+    ~FrameResourceScope()
+    {
+        _current = _previous;
+    }
+
+    // Resource of the innermost scope of the calling thread or nullptr if there is none.
+    static std::pmr::memory_resource* current() { return _current; }
+
+    FrameResourceScope(const FrameResourceScope&) = delete;
+    FrameResourceScope& operator=(const FrameResourceScope&) = delete;
+
+private:
+    static inline thread_local std::pmr::memory_resource* _current = nullptr;
+    std::pmr::memory_resource* _previous;
+};
+
+// Base class for a promise_type which allocates the coroutine frame from a memory resource.
+// If the first two arguments of the coroutine are std::allocator_arg and a memory resource,
+// the frame is allocated from that resource. Otherwise it comes from the resource set with
+// FrameResourceScope or from the heap if there is none. The resource must outlive the frame.
+// A frame which can't be allocated is not handled if exceptions are disabled because
+// std::pmr::memory_resource::allocate must not return nullptr. Then make sure that the
+// resource has room for the frame or that its out of arenas handler can make room.
+//   struct promise_type : MultiArena::ArenaFramePromise { ... };
+// GCC may warn with -Wmismatched-new-delete at a coroutine which takes std::allocator_arg
+// because the frame is allocated by a templated operator new and freed by the non-template
+// operator delete. The pairing is correct by design since the frame records the resource
+// it came from. The warning is reported at the coroutine, so silence it there with
+// #pragma GCC diagnostic ignored "-Wmismatched-new-delete" like example-5.cc does.
+struct ArenaFramePromise
+{
+    static void* operator new(std::size_t size)
+    {
+        return allocateFrame(size, FrameResourceScope::current());
+    }
+
+    template <class... Args>
+    static void* operator new(std::size_t size, std::allocator_arg_t, std::pmr::memory_resource& resource, Args&&...)
+    {
+        return allocateFrame(size, &resource);
+    }
+
+    template <class... Args>
+    static void* operator new(std::size_t size, std::allocator_arg_t, std::pmr::memory_resource* resource, Args&&...)
+    {
+        return allocateFrame(size, resource);
+    }
+
+    // Member coroutines get the object as the first argument.
+    template <class Object, class... Args>
+    static void* operator new(std::size_t size, Object&&, std::allocator_arg_t, std::pmr::memory_resource& resource, Args&&...)
+    {
+        return allocateFrame(size, &resource);
+    }
+
+    static void operator delete(void* p, std::size_t size)
+    {
+        std::pmr::memory_resource* resource;
+        std::memcpy(&resource, static_cast<char*>(p) + resourceOffset(size), sizeof(resource));
+        if (resource)
+            resource->deallocate(p, resourceOffset(size) + sizeof(resource));
+        else
+            ::operator delete(p);
+    }
+
+private:
+    // The resource is stored after the frame so that the frame can be deallocated.
+    static constexpr std::size_t resourceOffset(std::size_t size)
+    {
+        constexpr std::size_t align = alignof(std::pmr::memory_resource*);
+        return (size + align - 1) / align * align;
+    }
+
+    static void* allocateFrame(std::size_t size, std::pmr::memory_resource* resource)
+    {
+        std::size_t bytes = resourceOffset(size) + sizeof(resource);
+        void* p = resource ? resource->allocate(bytes) : ::operator new(bytes);
+        std::memcpy(static_cast<char*>(p) + resourceOffset(size), &resource, sizeof(resource));
+        return p;
+    }
+};
+
+} // namespace MultiArena
+
+#endif // MULTIARENA_COROUTINE_H
@@ -8,20 +8,27 @@
 #include <atomic>
 #include <mutex>
 #include <shared_mutex>
+#include <condition_variable>
+#include <chrono>
 #include <thread>
 #include <type_traits>
 #include <utility>
+#include <tuple>
 #include <functional>
 #include <memory>
 #include <memory_resource>
 #include <cstddef>
 #include <cstdint>
 #include <new>
+#include <stdexcept>
 #include <algorithm>
 #include <cmath>
+#if defined(__linux__)
+# include <sched.h>
+#endif
 
 /**
- * This library implements 4 memory resources which can be used
+ * This library implements arena memory resources which can be used
  * with C++17 polymorphic memory resources.
  * See https://en.cppreference.com/w/cpp/memory/polymorphic_allocator
  *
@@ -35,7 +42,7 @@
  * into an arena before tapping the next free arena.
  * On deallocation, it waits until every allocation in an arena
  * has been freed before recycling the arena.
- * The memory resources are:
+ * The two core memory resources come in four variants:
  * 1. UnsynchronizedArenaResource where the arenas are allocated from
  *    the stack or static memory.
  *    This variant is fast and cache-friendly but not thread-safe.
@@ -56,7 +63,27 @@
  *    when the arenas are initialized.
  *    This variant thread-safe but slightly slower than the unsynchronized one.
  *
- * In addition there is a fifth memory resource (StatisticsArenaResource)
+ * The other memory resources build on the core ones or on the same arenas:
+ * - OwnedArenaResource: an unsynchronized resource owned by one thread
+ *   which any thread may free into.
+ * - SingleProducerArenaResource: one thread allocates and any thread frees
+ *   without locks.
+ * - SignalSafeArenaResource: lock-free allocation and deallocation which may
+ *   be used in signal handlers.
+ * - ShardedArenaResource: the arenas are split into shards, by default one per
+ *   CPU, each with its own lock.
+ * - FrameArenaResource: a pool per frame for pipelines where frame N is produced
+ *   while frame N-1 is still being consumed.
+ * - MultiArenaSet and SynchronizedMultiArenaSet: tiers of arenas of different
+ *   sizes behind one memory resource.
+ * - ArenaLease and ThreadAllocationBuffer: exclusive arenas or slices of
+ *   a synchronized resource for the allocations of one thread.
+ * - LifetimeView and PriorityView: route allocations to a lifetime class
+ *   or a priority class of a resource.
+ * ArenaThreadPool.h and Coroutine.h (C++20) contain optional extensions
+ * for thread pools and coroutines.
+ *
+ * In addition there is a memory resource (StatisticsArenaResource)
  * which can be used for finding a suitable arena size and the number of arenas.
  * It keeps track of the sizes of all allocations and the maximum
  * number of occipied arenas. These values can be requested with
@@ -94,6 +121,9 @@
 #   include <exception>
 #endif
 
+// Enable / disable contention profiling of SynchronizedArenaResource
+// #define MULTIARENA_PROFILE 1
+
 namespace MultiArena
 {
 #if MULTIARENA_DISABLE_EXCEPTIONS
@@ -183,283 +213,366 @@ void constructPmrContainerAt(PMR_CONTAINER* pPmrCont, std::pmr::memory_resource*
     ::new (pPmrCont) PMR_CONTAINER(args..., mr);
 }
 
-template <SizeType NUM_ARENAS = 0, SizeType ARENA_SIZE = 0>
-class UnsynchronizedArenaResource;
+// Lifetime classes for routing allocations to separate active arenas.
+// An arena is recycled only when every allocation in it has been freed, so
+// keeping long-lived objects away from short-lived ones prevents them from
+// pinning arenas which would otherwise be recycled soon.
+enum class Lifetime : unsigned
+{
+    Default = 0,  // Allocations made through do_allocate
+    Frame,
+    Request,
+    Session
+};
+constexpr std::size_t numLifetimes = 4;
 
-// Base class for all variants of unsynchronized polymorphic memory resources.
-template <class Derived>
-class UnsynchronizedArenaResourceBase : public std::pmr::memory_resource
+// Priority classes of allocations. A number of free arenas can be kept in reserve
+// for high priority and emergency allocations. See setReserveArenas.
+enum class Priority : unsigned
 {
-public:
-    UnsynchronizedArenaResourceBase(SizeType /*numArenas*/, SizeType /*arenaSize*/)
-    {}
+    Normal = 0,  // May not tap the reserve arenas.
+    High,        // May tap the high priority reserve.
+    Emergency    // May tap any free arena, e.g. in error handling and logging paths.
+};
+constexpr std::size_t numPriorities = 3;
+
+// Handler which is called when an allocation can't be made because the resource
+// is out of free arenas, like std::new_handler. It gets the number of bytes requested
+// and the context pointer given to setOutOfArenasHandler. The handler can for example
+// free cached objects, release a frame or wait for a while. If it returns true,
+// the allocation is retried. If it returns false, the allocation fails.
+using OutOfArenasHandler = bool (*)(std::size_t bytes, void* context);
+
+// Handler which is called after a synchronized resource has released an arena or an active
+// arena has become vacant, so that an allocation which failed for the lack of free arenas may
+// now succeed. It gets the context pointer given to setArenaReleasedHandler.
+using ArenaReleasedHandler = void (*)(void* context);
+
+// Result of allocateAtLeast. Like std::allocation_result in C++23,
+// count is the number of bytes actually allocated.
+struct AllocationResult
+{
+    void* ptr;
+    std::size_t count;
+};
 
-    // Total number of allocations combined in all arenas.
-    std::size_t numberOfAllocations()
-    {
-        std::size_t result = 0;
-        for (SizeType i = 0; i < derived()->numArenas(); ++i)
-            result += allocationsInArena(i);
-        return result;
-    }
+// Order in which the free arenas are tapped.
+enum class ArenaSelectionPolicy : unsigned
+{
+    Lifo = 0,       // The most recently released arena first. Keeps the caches warm.
+    Ring,           // The next free arena by address after the previously tapped one.
+                    // Suits streams whose buffers are freed roughly in allocation order.
+    LowestAddress   // The free arena with the lowest address. Keeps the memory in use compact.
+};
 
-    // Number of non-empty arenas.
-    SizeType numberOfBusyArenas()
-    {
-        auto result = derived()->numArenas() - _freeListHead;
-        // The active arena is counted as a busy even if there
-        // are no allocations yet.
-        // If the active arena is the only one that possibly have allocations,
-        // we must check if the arena is actually empty.
-        if (result == 1 && allocationsInArena(_activeArenaId) == 0)
-            result = 0;
-        return result;
+// Bumps data by numBytes unless the block would extend past end. Returns the previous
+// value of data or 0 if the block does not fit. Unlike a plain fetch_add, a bump which
+// fails leaves data untouched so the tail of the arena is not wasted, and several
+// threads racing at the end of the arena can't push data past end.
+inline uintptr_t boundedBump(std::atomic<uintptr_t>& data, uintptr_t end, uintptr_t numBytes)
+{
+    uintptr_t prevData = data.load(std::memory_order_relaxed);
+    do {
+        if (numBytes > end - prevData)
+            return 0;
+    } while (!data.compare_exchange_weak(prevData, prevData + numBytes, std::memory_order_relaxed, std::memory_order_relaxed));
+    return prevData;
+}
+
+// Returns the CPU which runs the calling thread. If it can't be found out,
+// returns a hash of the thread id so that the threads are still spread out.
+inline unsigned currentCpu()
+{
+#if defined(__linux__) && defined(__GLIBC__)
+    int cpu = sched_getcpu();
+    if (cpu >= 0)
+        return unsigned(cpu);
+#endif
+    return unsigned(std::hash<std::thread::id>()(std::this_thread::get_id()));
+}
+
+// Number of free arenas marked in one word of the free arena bitmap.
+constexpr SizeType bitsPerWord = 64;
+
+inline unsigned countTrailingZeros(uint64_t word)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return unsigned(__builtin_ctzll(word));
+#else
+    unsigned n = 0;
+    for (; (word & 1) == 0; word >>= 1)
+        ++n;
+    return n;
+#endif
+}
+
+// Returns the index of the first set bit at or after index "from"
+// or numBits if there is none.
+template <class Bitmap>
+SizeType findNextSetBit(const Bitmap& bitmap, SizeType numBits, SizeType from)
+{
+    std::size_t wordIndex = from / bitsPerWord;
+    if (wordIndex >= bitmap.size())
+        return numBits;
+    uint64_t word = bitmap[wordIndex] & (~uint64_t(0) << (from % bitsPerWord));
+    while (word == 0) {
+        if (++wordIndex == bitmap.size())
+            return numBits;
+        word = bitmap[wordIndex];
     }
+    return SizeType(wordIndex * bitsPerWord + countTrailingZeros(word));
+}
 
-protected:
-    void initializeArenas()
+// Like findNextSetBit but wraps around to the beginning of the bitmap.
+template <class Bitmap>
+SizeType findNextSetBitCyclic(const Bitmap& bitmap, SizeType numBits, SizeType from)
+{
+    SizeType index = findNextSetBit(bitmap, numBits, from);
+    return (index < numBits) ? index : findNextSetBit(bitmap, numBits, 0);
+}
+
+// Storage of the free arena list of the unsynchronized resources.
+// The stack is in the first _freeListHead entries of the list with the top at the end.
+struct PlainFreeArenaStorage
+{
+    using Word = uint64_t;
+
+    static uint64_t loadWord(const Word& word) { return word; }
+    static void clearWord(Word& word) { word = 0; }
+    static void setBits(Word& word, uint64_t bits) { word |= bits; }
+
+    // Returns false if the bits were clear already.
+    static bool clearBits(Word& word, uint64_t bits)
     {
-        // Initialize arena free list
-        for (SizeType i = 0; i < derived()->numArenas(); ++i) {
-            derived()->_freeList[i] = derived()->numArenas() - 1 - i;
-            derived()->_numAllocationsInArena[i] = 0;
-        }
-        _freeListHead = derived()->numArenas();
-        // Activate the first arena. Al least one arena must be active at all times.
-        reserveNextArena();
+        bool bWasSet = (word & bits) != 0;
+        word &= ~bits;
+        return bWasSet;
     }
 
-    void* _data;                // Pointer to the beginning of the allocated section within the active arena.
+    // Note: _freeListHead has been decremented before popStack and is incremented after pushStack.
+    template <class List>
+    SizeType popStack(List& list) { return list[_freeListHead]; }
 
-    SizeType _bytesLeft;        // Number of free bytes remaining in the active arena, including alignment.
-    SizeType _activeArenaId;    // Id of the active arena;
-    SizeType _freeListHead;     // Indices smaller than this contain free arenas.
+    template <class List>
+    void pushStack(List& list, SizeType arenaId) { list[_freeListHead] = arenaId; }
 
-    // Returns true and updates the active arena member variables if a free arena is available.
-    // Otherwise, returns false and doesn't change anything.
-    // Note: the mutex must be locked before this function is called in synchronized mode.
-    bool reserveNextArena()
+    // Stacks the arenas for which isFree(arenaId) is true so that the lowest one is on top.
+    template <class List, class IsFree>
+    void buildStack(List& list, SizeType numArenas, IsFree isFree)
     {
-        if (_freeListHead == 0)
-            return false;
-        --_freeListHead;
-        _bytesLeft = derived()->arenaSize();
-        _activeArenaId = derived()->_freeList[_freeListHead];
-        // Initially, _data points to one past the last byte of the arena.
-        _data = derived()->_arenaData.data() + derived()->arenaSize() * (_activeArenaId + 1);
-        return true;
+        SizeType n = 0;
+        for (SizeType i = numArenas; i-- > 0; )
+            if (isFree(i))
+                list[n++] = i;
+        MULTIARENA_ASSERT(n == _freeListHead);
     }
 
-    // Re-initialize the active arena in an optimized way without
-    // release/reserve cycle.
-    // Note: mutex must be locked before this function is called in synchronized mode.
-    void resetActiveArena()
+    template <class List, class Function>
+    void forEachInStack(const List& list, Function f) const
     {
-        MULTIARENA_ASSERT(allocationsInArena(_activeArenaId) == 0);
-        _bytesLeft = derived()->arenaSize();
-        _data = derived()->_arenaData.data() + derived()->arenaSize() * (_activeArenaId + 1);
-        derived()->_numAllocationsInArena[_activeArenaId] = 0;
+        for (SizeType i = 0; i < _freeListHead; ++i)
+            f(list[i]);
     }
 
-    // Recycle the given arena by moving it to the freelist.
-    // Returns true if all arenas become empty.
-    // Note: mutex must be locked before this function is called in synchronized mode.
-    void releaseArena(SizeType arenaId)
+    SizeType _freeListHead = 0; // Number of free arenas. See FreeArenaList.
+};
+
+// Storage of the free arena list of the synchronized resources.
+// The links of the stack are in the list and the words of the bitmap are atomic.
+// A free arena is pushed with a compare-and-swap under the shared lock so that the recycle
+// path in do_deallocate needs no exclusive lock. Arenas are popped and the free list is
+// converted only under the exclusive lock, so there is a single popper at a time. The pushers
+// only put new arenas on top, so a popped top can't come back before the pop ends and
+// the top needs no tag against ABA.
+struct AtomicFreeArenaStorage
+{
+    using Word = std::atomic<uint64_t>;
+
+    static uint64_t loadWord(const Word& word) { return word.load(std::memory_order_relaxed); }
+    static void clearWord(Word& word) { word.store(0, std::memory_order_relaxed); }
+    static void setBits(Word& word, uint64_t bits) { word.fetch_or(bits, std::memory_order_release); }
+
+    // Returns false if the bits were clear already.
+    static bool clearBits(Word& word, uint64_t bits)
     {
-        MULTIARENA_ASSERT(allocationsInArena(arenaId) == 0);
-        MULTIARENA_ASSERT(_freeListHead < derived()->numArenas());
-        derived()->_freeList[_freeListHead++] = arenaId;
-        derived()->_numAllocationsInArena[arenaId] = 0;
+        return (word.fetch_and(~bits, std::memory_order_acquire) & bits) != 0;
     }
 
-private:
-    auto derived() const
+    // Note: the exclusive lock must be held. The compare-and-swap only races with pushes.
+    template <class List>
+    SizeType popStack(List& list)
     {
-        return static_cast<const Derived*>(this);
+        SizeType arenaId = _freeStackTop.load(std::memory_order_acquire);
+        do {
+            MULTIARENA_ASSERT(arenaId != noArena);
+        } while (!_freeStackTop.compare_exchange_weak(arenaId, list[arenaId],
+                                                      std::memory_order_acquire, std::memory_order_acquire));
+        return arenaId;
     }
 
-    auto derived()
+    template <class List>
+    void pushStack(List& list, SizeType arenaId)
     {
-        return static_cast<Derived*>(this);
+        SizeType top = _freeStackTop.load(std::memory_order_relaxed);
+        do {
+            list[arenaId] = top;
+        } while (!_freeStackTop.compare_exchange_weak(top, arenaId, std::memory_order_release, std::memory_order_relaxed));
     }
 
-    // Returns nullptr if all arenas are out of memory and the allocation can't hence be made.
-    void* do_allocate_details(std::size_t bytes, std::size_t alignment)
+    // Stacks the arenas for which isFree(arenaId) is true so that the lowest one is on top.
+    template <class List, class IsFree>
+    void buildStack(List& list, SizeType numArenas, IsFree isFree)
     {
-        uintptr_t ptrAsInteger = reinterpret_cast<uintptr_t>(_data);
-        ptrAsInteger -= bytes;  // Tentative result excluding alignment.
-        SizeType alignmentOffset = ptrAsInteger & (alignment - 1); // Assume alignment is a power of 2
-        SizeType numBytesNeeded = SizeType(bytes) + alignmentOffset; // Final amount of bytes needed
-        if (numBytesNeeded > _bytesLeft) {
-            // Not enough space in this arena. Tap the next one.
-            if (bytes <= derived()->arenaSize() && reserveNextArena())
-                // There is enough space in the next arena so the recursion will occur only once.
-                return do_allocate_details(bytes, alignment);
-            else  // Out of luck. bad_alloc will be thrown if exceptions are enabled.
-                return nullptr;
+        SizeType top = noArena;
+        SizeType n = 0;
+        for (SizeType i = numArenas; i-- > 0; ) {
+            if (isFree(i)) {
+                list[i] = top;
+                top = i;
+                ++n;
+            }
         }
-        ptrAsInteger -= alignmentOffset;
-        _data = reinterpret_cast<void*>(ptrAsInteger);
-        _bytesLeft -= numBytesNeeded;
+        MULTIARENA_ASSERT(n == _freeListHead);
+        _freeStackTop.store(top, std::memory_order_relaxed);
+    }
 
-        // Update the number of allocations made in the current arena.
-        ++(derived()->_numAllocationsInArena[_activeArenaId]);
-        return _data;
+    template <class List, class Function>
+    void forEachInStack(const List& list, Function f) const
+    {
+        for (SizeType i = _freeStackTop.load(); i != noArena; i = list[i])
+            f(i);
     }
 
+    static constexpr SizeType noArena = ~SizeType(0);
+
+    std::atomic<SizeType> _freeListHead {0}; // Number of free arenas. See FreeArenaList.
+    std::atomic<SizeType> _freeStackTop {noArena}; // Top of the free arena stack.
+};
+
+// Free arenas of a resource. With ArenaSelectionPolicy::Lifo, they are in a stack whose
+// entries are in Derived::_freeList. With the other policies, they are in a bitmap in
+// Derived::_freeBitmap. Either way, _freeListHead is the number of free arenas.
+// Storage is PlainFreeArenaStorage for the unsynchronized resources
+// and AtomicFreeArenaStorage for the synchronized ones.
+template <class Derived, class Storage>
+class FreeArenaList : protected Storage
+{
+public:
+    ArenaSelectionPolicy arenaSelectionPolicy() const { return _policy; }
+
 protected:
-    void* do_allocate(std::size_t bytes, std::size_t alignment) override
+    // Makes all arenas free. The arena with the lowest address is tapped first.
+    void initializeFreeList()
     {
-        if (bytes == 0)
-            return nullptr;
-        void* result = do_allocate_details(bytes, alignment);
-        if constexpr (exceptionsEnabled) {
-            if (result == nullptr) { // Find out the reason for failure.
-                if (bytes > derived()->arenaSize()) // Too large block requested
-                    throw AllocateTooLargeBlock(bytes, derived()->arenaSize());
-                else
-                    throw OutOfFreeArenas(derived()->numArenas());
-            }
-        }
-        return result;
+        this->_freeListHead = derived()->numArenas();
+        for (auto& word : derived()->_freeBitmap)
+            Storage::clearWord(word);
+        for (SizeType i = 0; i < derived()->numArenas(); ++i)
+            setFreeBit(i);
+        this->buildStack(derived()->_freeList, derived()->numArenas(), [](SizeType) { return true; });
+        _ringCursor = 0;
     }
 
-    // Virtual allocate function.
-    // Note that bytes and alignment are used only when an exception is thrown
-    // so they are actually only debug helpers and may be left out.
-    void do_deallocate(void* p,
-                       std::size_t bytes = 0,
-                       std::size_t alignment = alignof(std::max_align_t)) override
+    // Takes a free arena out of the free list according to the selection policy.
+    SizeType popFreeArena()
     {
-        if (p == nullptr)
-            return;
-        // Calculate the id of the arena where the address has come from.
-        uintptr_t ptrAsInteger = reinterpret_cast<uintptr_t>(p);
-        uintptr_t dataAsInteger = reinterpret_cast<uintptr_t>(derived()->_arenaData.data());
-        SizeType arenaId = SizeType(ptrAsInteger - dataAsInteger) / derived()->arenaSize();
-        if constexpr (exceptionsEnabled) {
-            if (arenaId >= derived()->numArenas()) // There is either double-free or memory corruption
-                throw ArenaMemoryResourceCorruption(p, bytes, alignment);
-        }
-        // Did the arena become vacant? If so, either reuse or release.
-        SizeType numAllocs = --(derived()->_numAllocationsInArena[arenaId]);
-        if (numAllocs == 0) {
-            if (arenaId == _activeArenaId)
-                resetActiveArena(); // The currently active arena became empty so reuse it.
-            else
-                releaseArena(arenaId); // Release the arena back to the free list.
-        }
+        MULTIARENA_ASSERT(this->_freeListHead > 0);
+        --this->_freeListHead;
+        if (_policy == ArenaSelectionPolicy::Lifo)
+            return this->popStack(derived()->_freeList);
+        // Where to start looking for a free arena.
+        SizeType from = 0;
+        if (_policy == ArenaSelectionPolicy::Ring)
+            from = _ringCursor;
+        SizeType arenaId;
+        do {
+            arenaId = findNextSetBitCyclic(derived()->_freeBitmap, derived()->numArenas(), from);
+        } while (!clearFreeBit(arenaId));
+        _ringCursor = arenaId + 1;
+        return arenaId;
     }
 
-    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    void pushFreeArena(SizeType arenaId)
     {
-        return (this == &other);
+        MULTIARENA_ASSERT(this->_freeListHead < derived()->numArenas());
+        if (_policy == ArenaSelectionPolicy::Lifo)
+            this->pushStack(derived()->_freeList, arenaId);
+        else
+            setFreeBit(arenaId);
+        ++this->_freeListHead;
     }
 
-    // Number of currently active allocation in the given arena.
-    SizeType allocationsInArena(SizeType arenaId) const
+    // Moves the free arenas from the stack to the bitmap or vice versa.
+    void convertFreeList(ArenaSelectionPolicy policy)
     {
-        return derived()->_numAllocationsInArena[arenaId];
+        if (policy == ArenaSelectionPolicy::Lifo) {
+            // The arena with the lowest address will be on top of the stack.
+            this->buildStack(derived()->_freeList, derived()->numArenas(),
+                             [this](SizeType arenaId) { return isFreeBit(arenaId); });
+        }
+        else if (_policy == ArenaSelectionPolicy::Lifo) {
+            for (auto& word : derived()->_freeBitmap)
+                Storage::clearWord(word);
+            this->forEachInStack(derived()->_freeList, [this](SizeType arenaId) { setFreeBit(arenaId); });
+        }
+        _policy = policy;
     }
-}; // UnsynchronizedArenaResourceBase
-
 
-// Unsynchronized (i.e. non-thread-safe) memory resource where the data
-// is allocated from the stack.
-template <SizeType NUM_ARENAS, SizeType ARENA_SIZE>
-class UnsynchronizedArenaResource :
-    public UnsynchronizedArenaResourceBase<UnsynchronizedArenaResource<NUM_ARENAS, ARENA_SIZE>>
-{
-public:
-    using Base = UnsynchronizedArenaResourceBase<UnsynchronizedArenaResource<NUM_ARENAS, ARENA_SIZE>>;
-    explicit UnsynchronizedArenaResource(SizeType = 0, SizeType = 0, std::pmr::memory_resource* = nullptr) : Base(NUM_ARENAS, ARENA_SIZE)
+    void setFreeBit(SizeType arenaId)
     {
-        static_assert(NUM_ARENAS > 0, "There must be at least one arena.");
-        static_assert(ARENA_SIZE % alignof(std::max_align_t) == 0," Arena size must be divisible by max alignment.");
-        this->initializeArenas();
+        Storage::setBits(derived()->_freeBitmap[arenaId / bitsPerWord], uint64_t(1) << (arenaId % bitsPerWord));
     }
 
-    constexpr SizeType numArenas() { return NUM_ARENAS; }
-    constexpr SizeType arenaSize() { return ARENA_SIZE; }
-
-    friend class UnsynchronizedArenaResourceBase<UnsynchronizedArenaResource<NUM_ARENAS, ARENA_SIZE>>;
-protected:
-    // Number of allocations in each arena since the arena was activated.
-    std::array<SizeType, NUM_ARENAS> _numAllocationsInArena;
-    // List of free arenas.
-    std::array<SizeType, NUM_ARENAS> _freeList;
-    alignas(hardware_constructive_interference_size) // Align to a cache line.
-        std::array<std::byte, ARENA_SIZE * NUM_ARENAS> _arenaData;
-};  // UnsynchronizedArenaResource in stack
-
-// Unsynchronized (i.e. non-thread-safe) memory resource where the data
-// is allocated from the given memory resource (system heap by default.)
-template <>
-class UnsynchronizedArenaResource<0, 0> :
-    public UnsynchronizedArenaResourceBase<UnsynchronizedArenaResource<0, 0>>
-{
-public:
-    using Base = UnsynchronizedArenaResourceBase<UnsynchronizedArenaResource<0, 0>>;
-    explicit UnsynchronizedArenaResource(SizeType numArenas, SizeType arenaSize, std::pmr::memory_resource* mr = nullptr)
-        : Base(numArenas, arenaSize), _numArenas(numArenas), _arenaSize(arenaSize)
+    // Returns false if the bit was clear already.
+    bool clearFreeBit(SizeType arenaId)
     {
-        assert(numArenas > 0);
-        assert(arenaSize % alignof(std::max_align_t) == 0);
-        if (!mr)
-            mr = std::pmr::new_delete_resource();
-
-        // Allocate arenas using the given memory resource.
-        constructPmrContainerAt(&_numAllocationsInArena, mr, numArenas);
-        constructPmrContainerAt(&_freeList, mr, numArenas);
-        constructPmrContainerAt(&_arenaData, mr, numArenas * arenaSize, std::byte{});
-
-        this->initializeArenas();
+        return Storage::clearBits(derived()->_freeBitmap[arenaId / bitsPerWord], uint64_t(1) << (arenaId % bitsPerWord));
     }
 
-    SizeType numArenas() const { return _numArenas; }
-    SizeType arenaSize() const { return _arenaSize; }
-
-    friend class UnsynchronizedArenaResourceBase<UnsynchronizedArenaResource<0, 0>>;
-
-protected:
-    // Number of allocations in each arena since the arena was activated.
-    std::pmr::vector<SizeType> _numAllocationsInArena;
-    // List of free arenas.
-    std::pmr::vector<SizeType> _freeList;
-    std::pmr::vector<std::byte> _arenaData;
+    bool isFreeBit(SizeType arenaId)
+    {
+        return Storage::loadWord(derived()->_freeBitmap[arenaId / bitsPerWord]) & (uint64_t(1) << (arenaId % bitsPerWord));
+    }
 
-    SizeType _numArenas;  // Number of arenas.
-    SizeType _arenaSize;  // Size of each arena in bytes.
-};  // UnsynchronizedArenaResource in heap
+    ArenaSelectionPolicy _policy = ArenaSelectionPolicy::Lifo;
+    SizeType _ringCursor = 0;   // The ring policy taps the first free arena at or after this one.
 
-// Two atomic counters living in the same cache line if aligned properly.
-struct AllocationCounter
-{
-    std::atomic<SizeType> allocations = 0;
-    std::atomic<SizeType> deallocations = 0;
-    void reset()
+private:
+    auto derived()
     {
-        allocations = 0;
-        deallocations = 0;
+        return static_cast<Derived*>(this);
     }
 };
 
-// Forward declarations of memory resource classes.
 template <SizeType NUM_ARENAS = 0, SizeType ARENA_SIZE = 0>
-class SynchronizedArenaResource;
+class UnsynchronizedArenaResource;
 
-// Base class for all variants of synchronized polymorphic memory resources.
+template <class Resource>
+class ArenaLease;
+
+template <class Resource>
+class ThreadAllocationBuffer;
+
+// Base class for all variants of unsynchronized polymorphic memory resources.
 template <class Derived>
-class SynchronizedArenaResourceBase : public std::pmr::memory_resource
+class UnsynchronizedArenaResourceBase : public std::pmr::memory_resource,
+                                        public FreeArenaList<Derived, PlainFreeArenaStorage>
 {
+protected:
+    using FreeList = FreeArenaList<Derived, PlainFreeArenaStorage>;
+    using FreeList::_freeListHead;
+    using FreeList::_policy;
+    using FreeList::popFreeArena;
+    using FreeList::pushFreeArena;
+    using FreeList::convertFreeList;
+
 public:
-    SynchronizedArenaResourceBase(SizeType /*numArenas*/, SizeType /*arenaSize*/)
+    UnsynchronizedArenaResourceBase(SizeType /*numArenas*/, SizeType /*arenaSize*/)
     {}
 
     // Total number of allocations combined in all arenas.
     std::size_t numberOfAllocations()
     {
-        const std::lock_guard<std::shared_mutex> lock(_mtx);
         std::size_t result = 0;
         for (SizeType i = 0; i < derived()->numArenas(); ++i)
             result += allocationsInArena(i);
@@ -469,82 +582,513 @@ public:
     // Number of non-empty arenas.
     SizeType numberOfBusyArenas()
     {
-        const std::lock_guard<std::shared_mutex> lock(_mtx);
         auto result = derived()->numArenas() - _freeListHead;
-        // The active arena is counted as a busy even if there
-        // are no allocations yet.
-        // If the active arena is the only one that possibly have allocations,
-        // we must check if the arena is actually empty.
-        if (result == 1 && allocationsInArena(_activeArenaId) == 0)
-            result = 0;
+        // The active arenas are counted as a busy even if there
+        // are no allocations yet so we must check if they are actually empty.
+        for (const ActiveArena& lane : _active)
+            if (lane.arenaId != noArena && allocationsInArena(lane.arenaId) == 0)
+                --result;
         return result;
     }
 
-protected:
-    void initializeArenas()
+    // Returns true if the given address lies within the arenas of this resource.
+    bool contains(const void* p) const
     {
-        // Initialize arena free list
-        for (SizeType i = 0; i < derived()->numArenas(); ++i) {
-            derived()->_freeList[i] = derived()->numArenas() - 1 - i;
-            derived()->_numAllocationsInArena[i].reset();
-        }
-        _freeListHead = derived()->numArenas();
-        // Activate the first arena. Al least one arena must be active at all times.
-        reserveNextArena();
+        uintptr_t ptrAsInteger = reinterpret_cast<uintptr_t>(p);
+        uintptr_t dataAsInteger = reinterpret_cast<uintptr_t>(derived()->_arenaData.data());
+        return ptrAsInteger >= dataAsInteger &&
+               ptrAsInteger - dataAsInteger < std::size_t(derived()->numArenas()) * derived()->arenaSize();
     }
 
-    std::atomic<uintptr_t> _data;    // Pointer to the next free address within the active arena.
-
-    SizeType _activeArenaId;    // Id of the active arena;
-    SizeType _freeListHead;     // Indices smaller than this contain free arenas.
-    std::shared_mutex _mtx;
+    // Allocates from the active arena of the given lifetime class.
+    // Objects of different lifetime classes never share an arena.
+    void* allocateFor(Lifetime lifetime, std::size_t bytes, std::size_t alignment = alignof(std::max_align_t))
+    {
+        return allocateFromLane(_active[std::size_t(lifetime)], bytes, alignment);
+    }
 
-    // Pointer to the beginning of the data buffer of the given arena
-    uintptr_t arenaBegin(SizeType arenaId) const
+    // Allocates from the arena which owns the allocated address p if there is still
+    // room below the allocation frontier of that arena. Otherwise, allocates from
+    // the active arena like do_allocate. Related objects like the nodes of a list
+    // or a tree allocated this way tend to share arenas, which improves cache locality
+    // and lets the arenas be recycled together.
+    void* allocateNear(const void* p, std::size_t bytes, std::size_t alignment = alignof(std::max_align_t))
     {
-        return reinterpret_cast<uintptr_t>(derived()->_arenaData.data()) + arenaId * derived()->arenaSize();
+        if (p != nullptr && bytes > 0 && contains(p)) {
+            SizeType arenaId = arenaIdOf(p);
+            // If the arena is active for some lifetime class, allocate from that class.
+            if (ActiveArena* lane = activeArenaOf(arenaId))
+                return allocateFromLane(*lane, bytes, alignment);
+            // A full arena may still have room left below its frontier.
+            // Retired arenas are not touched while a marker is set because rollback can't undo it.
+            if (allocationsInArena(arenaId) > 0 && _markDepth == 0) {
+                SizeType& frontier = derived()->_bytesLeftInArena[arenaId];
+                ActiveArena arena{arenaEnd(arenaId) - (derived()->arenaSize() - frontier), frontier, arenaId};
+                if (void* result = bumpAllocate(bytes, alignment, arena)) {
+                    frontier = arena.bytesLeft;
+                    return result;
+                }
+            }
+        }
+        return allocateFromLane(_active[0], bytes, alignment);
     }
 
-    // Number of bytes reserved in the active arena
-    SizeType bytesReserved() const
+    // Allocates at least the given number of bytes and returns the pointer together with the number
+    // of bytes actually allocated. If the rest of the active arena would be too small for another
+    // block of the same size, the whole rest is handed out so that it isn't wasted.
+    AllocationResult allocateAtLeast(std::size_t bytes, std::size_t alignment = alignof(std::max_align_t))
     {
-        return SizeType(_data.load(std::memory_order_relaxed) - arenaBegin(_activeArenaId));
+        if (bytes == 0)
+            return {nullptr, 0};
+        ActiveArena& lane = _active[0];
+        // The free part of the active arena is below lane.data.
+        uintptr_t begin = (arenaBegin(lane.arenaId) + alignment - 1) & ~uintptr_t(alignment - 1);
+        uintptr_t data = reinterpret_cast<uintptr_t>(lane.data);
+        if (data >= begin && data - begin >= bytes && data - begin - bytes < bytes) {
+            std::size_t tail = data - begin;
+            lane.data = reinterpret_cast<void*>(begin);
+            lane.bytesLeft = SizeType(begin - arenaBegin(lane.arenaId));
+            ++(derived()->_numAllocationsInArena[lane.arenaId]);
+            return {lane.data, tail};
+        }
+        return {allocateFromLane(lane, bytes, alignment), bytes};
     }
 
-    // Returns true and updates the active arena member variables if a free arena is available.
-    // Otherwise, returns false and doesn't change anything.
-    // Note: the mutex must be locked before this function is called.
-    bool reserveNextArena()
+    // Releases all allocations at once and returns every arena to the free list
+    // like std::pmr::monotonic_buffer_resource::release. The objects are not deallocated
+    // one by one so the caller must make sure that none of them is used after the call.
+    // The cost is proportional to the number of arenas, not to the number of allocations.
+    // No reservation may be held during the call.
+    void release()
     {
-        if (_freeListHead == 0)
-            return false;
-        --_freeListHead;
-        _activeArenaId = derived()->_freeList[_freeListHead];
-        // _data points to the first byte of the arena.
-        _data = arenaBegin(_activeArenaId);
-        return true;
+#if MULTIARENA_DEBUG
+        if (std::size_t n = numberOfAllocations(); n > 0)
+            atomicPrint("release: ", n, " allocations outstanding in ", numberOfBusyArenas(), " arenas.\n");
+#endif
+        initializeArenas();
     }
 
-    // Re-initialize the active arena in an optimized way without
-    // release/reserve cycle.
-    // Note: mutex must be locked before this function is called.
-    void resetActiveArena()
+    // Sets the handler which is called when the resource runs out of free arenas.
+    // The allocation is retried after each call at most maxRetries times.
+    // Set handler to nullptr to fail immediately, which is the default.
+    void setOutOfArenasHandler(OutOfArenasHandler handler, void* context = nullptr, SizeType maxRetries = 3)
     {
-        MULTIARENA_ASSERT(allocationsInArena(_activeArenaId) == 0);
-        _data = arenaBegin(_activeArenaId);
-        derived()->_numAllocationsInArena[_activeArenaId].reset();
+        _outOfArenasHandler = handler;
+        _outOfArenasContext = context;
+        _maxRetries = maxRetries;
     }
 
-    // Recycle the given arena by moving it to the freelist.
-    // Returns true if all arenas become empty.
-    // Note: mutex must be locked before this function is called in synchronized mode.
-    void releaseArena(SizeType arenaId)
+    // Keeps the given numbers of free arenas in reserve. Normal priority allocations
+    // can't tap the reserve arenas, high priority allocations can tap the high priority
+    // reserve and emergency allocations can tap every free arena.
+    void setReserveArenas(SizeType highPriorityArenas, SizeType emergencyArenas)
+    {
+        _highPriorityArenas = highPriorityArenas;
+        _emergencyArenas = emergencyArenas;
+    }
+
+    // Allocates with the given priority. High priority and emergency allocations are made
+    // from the default active arena as long as it can tap arenas outside the reserve.
+    // After that, they tap the reserve arenas into a lane of their own so that normal
+    // allocations never fill a reserve arena.
+    void* allocateWithPriority(Priority priority, std::size_t bytes, std::size_t alignment = alignof(std::max_align_t))
+    {
+        if (priority != Priority::Normal && bytes > 0) {
+            if (void* result = do_allocate_details(bytes, alignment, _active[0], Priority::Normal))
+                return result;
+            return allocateFromLane(_active[reserveLane], bytes, alignment, priority);
+        }
+        return allocateFromLane(_active[0], bytes, alignment);
+    }
+
+    // Number of times an allocation of the given priority has tapped a reserve arena.
+    SizeType numberOfReserveTaps(Priority priority) const
+    {
+        return _reserveTaps[std::size_t(priority)];
+    }
+
+    // Number of times an active arena has been replaced with a free arena.
+    std::size_t numberOfArenaSwitches() const { return _numArenaSwitches; }
+
+    // Sets aside enough whole arenas for count allocations of at most the given size
+    // each and returns them as a reservation. Allocations made through the reservation
+    // are guaranteed to succeed until the reserved space runs out. The arenas which were
+    // not tapped are returned to the resource when the reservation is released.
+    // If there are not enough free arenas or nothing is reserved (i.e. bytes or count is zero),
+    // the returned reservation is not valid().
+    // Reservations can't be mixed with markers. While a marker is set, the returned
+    // reservation is not valid() either.
+    ArenaLease<Derived> reserve(std::size_t bytes, std::size_t count)
+    {
+        SizeType numArenas = arenasNeeded(bytes, count);
+        if (_markDepth > 0 || numArenas == 0 || numArenas == noArena || _freeListHead < tapThreshold(Priority::Normal) + numArenas)
+            return ArenaLease<Derived>();
+        _reservedArenas += numArenas;
+        return ArenaLease<Derived>(*derived(), numArenas);
+    }
+
+    // Number of free arenas set aside for reservations.
+    SizeType numberOfReservedArenas() const { return _reservedArenas; }
+
+    template <class Resource>
+    friend class ArenaLease;
+
+    // Sets the order in which free arenas are tapped. See ArenaSelectionPolicy.
+    // The policy can't be changed while a marker is set. Then throws std::logic_error
+    // or, if exceptions are disabled, keeps the current policy.
+    void setArenaSelectionPolicy(ArenaSelectionPolicy policy)
+    {
+        if (_markDepth > 0) {
+            if constexpr (exceptionsEnabled)
+                throw std::logic_error("The arena selection policy can't be changed while a marker is set.");
+            return;
+        }
+        if (policy != _policy)
+            convertFreeList(policy);
+    }
+
+    struct Marker;
+
+    // Sets a marker to the current state of the resource. Everything allocated after
+    // the marker can be released at once with rollback(marker).
+    // Markers can be nested but they must be rolled back in reverse order.
+    // No arena is recycled while a marker is set. The arenas emptied by freeing objects
+    // allocated before the outermost marker are recycled when it is rolled back.
+    // Markers can be used only with ArenaSelectionPolicy::Lifo. If the policy is different,
+    // throws std::logic_error or, if exceptions are disabled, switches to the Lifo policy.
+    // Markers can't be set while an arena is leased or reserved. Then throws std::logic_error
+    // or, if exceptions are disabled, returns a marker which is not set (i.e. depth is 0)
+    // and whose rollback does nothing.
+    Marker mark()
+    {
+        if (_numLeasedArenas > 0 || _reservedArenas > 0) {
+            if constexpr (exceptionsEnabled)
+                throw std::logic_error("Markers can't be set while arenas are leased or reserved.");
+            return Marker{};
+        }
+        if (_policy != ArenaSelectionPolicy::Lifo) {
+            if constexpr (exceptionsEnabled)
+                throw std::logic_error("Markers can be used only with ArenaSelectionPolicy::Lifo.");
+            convertFreeList(ArenaSelectionPolicy::Lifo);
+        }
+        Marker marker;
+        marker.boundary = Boundary{_active, _freeListHead};
+        marker.outer = _innermostMark;
+        for (std::size_t i = 0; i < numLanes; ++i)
+            marker.numAllocations[i] = (_active[i].arenaId != noArena) ? allocationsInArena(_active[i].arenaId) : 0;
+        marker.depth = ++_markDepth;
+        _innermostMark = marker.boundary;
+        if (marker.depth == 1)
+            _outermostMark = marker.boundary;
+        return marker;
+    }
+
+    // Releases everything allocated after the given marker was set.
+    // The work done is proportional to the number of arenas tapped after the marker,
+    // not to the number of allocations.
+    void rollback(const Marker& marker)
+    {
+        if (marker.depth == 0)
+            return;
+        MULTIARENA_ASSERT(marker.depth == _markDepth);
+        // The arenas tapped after the marker are still in the free list
+        // because the free list is not pushed to while a marker is set.
+        for (SizeType i = _freeListHead; i < marker.boundary.freeListHead; ++i) {
+            SizeType arenaId = derived()->_freeList[i];
+            derived()->_numAllocationsInArena[arenaId] = 0;
+            derived()->_bytesLeftInArena[arenaId] = 0;
+        }
+        _freeListHead = marker.boundary.freeListHead;
+        _active = marker.boundary.active;
+        // The objects allocated before the outermost marker and freed since then are subtracted.
+        bool bOutermost = (marker.depth == 1);
+        for (std::size_t i = 0; i < numLanes; ++i)
+            if (_active[i].arenaId != noArena)
+                derived()->_numAllocationsInArena[_active[i].arenaId] = marker.numAllocations[i] - (bOutermost ? _preMarkFrees[i] : 0);
+        _innermostMark = marker.outer;
+        _markDepth = marker.depth - 1;
+        if (bOutermost)
+            recyclePreMarkFrees();
+    }
+
+    // Number of markers currently set.
+    SizeType markDepth() const { return _markDepth; }
+
+protected:
+    // Returns true if the allocated address p was allocated after the innermost marker.
+    bool allocatedAfterMark(const void* p)
+    {
+        return allocatedAfterMark(p, _innermostMark);
+    }
+
+    void initializeArenas()
+    {
+        _markDepth = 0;
+        _numLeasedArenas = 0;
+        _preMarkFrees = {};
+        _pendingRelease = noArena;
+        _reservedArenas = 0;
+        for (SizeType i = 0; i < derived()->numArenas(); ++i) {
+            derived()->_numAllocationsInArena[i] = 0;
+            derived()->_bytesLeftInArena[i] = 0;
+        }
+        this->initializeFreeList();
+        // The lifetime classes tap their first arena on demand.
+        for (ActiveArena& lane : _active)
+            lane = ActiveArena{nullptr, 0, noArena};
+        // Activate the first arena. Al least one arena must be active at all times.
+        reserveNextArena(_active[0], Priority::Emergency);
+    }
+
+    // Id of an arena which does not exist.
+    static constexpr SizeType noArena = ~SizeType(0);
+
+    // The lifetime classes have a lane each and the reserve arenas have a lane of their own.
+    static constexpr std::size_t numLanes = numLifetimes + 1;
+    static constexpr std::size_t reserveLane = numLifetimes;
+
+    // State of the arena which is currently active for a lifetime class.
+    struct ActiveArena
+    {
+        void* data;          // Pointer to the beginning of the allocated section within the arena.
+        SizeType bytesLeft;  // Number of free bytes remaining in the arena, including alignment.
+        SizeType arenaId;    // Id of the arena or noArena if the lifetime class has not tapped one yet.
+    };
+
+    // The part of the state of the resource which is restored by rollback.
+    struct Boundary
+    {
+        std::array<ActiveArena, numLanes> active;
+        SizeType freeListHead;
+    };
+
+public:
+    struct Marker
+    {
+        Boundary boundary;  // State of the resource when the marker was set.
+        Boundary outer;     // Boundary of the enclosing marker.
+        std::array<SizeType, numLanes> numAllocations; // Allocations in the active arenas.
+        SizeType depth;     // Nesting depth of the marker, starting from 1.
+    };
+
+protected:
+    // One active arena per lane. The first one is used by do_allocate.
+    std::array<ActiveArena, numLanes> _active;
+    SizeType _markDepth = 0;    // Number of markers set. See mark().
+    SizeType _numLeasedArenas = 0; // Number of arenas leased by reservations. See beginLease().
+    Boundary _innermostMark;    // Boundary of the innermost marker.
+    Boundary _outermostMark;    // Boundary of the outermost marker.
+    std::array<SizeType, numLanes> _preMarkFrees {}; // Objects allocated before the outermost marker and freed since.
+    SizeType _pendingRelease = noArena; // First of the arenas to be released at the outermost rollback.
+    SizeType _reservedArenas = 0; // Number of free arenas which only reservations may tap.
+    SizeType _highPriorityArenas = 0; // Number of free arenas kept for high priority allocations.
+    SizeType _emergencyArenas = 0;    // Number of free arenas kept for emergency allocations.
+    std::array<SizeType, numPriorities> _reserveTaps {}; // Reserve arenas tapped by each priority.
+    std::size_t _numArenaSwitches = 0; // Times an active arena has been replaced with a free one.
+    OutOfArenasHandler _outOfArenasHandler = nullptr;
+    void* _outOfArenasContext = nullptr;
+    SizeType _maxRetries = 0;   // How many times the handler may be called per allocation.
+
+    // An allocation of the given priority may tap a free arena only if there are
+    // more free arenas than this.
+    SizeType tapThreshold(Priority priority) const
+    {
+        SizeType threshold = _reservedArenas;
+        if (priority == Priority::Normal)
+            threshold += _highPriorityArenas + _emergencyArenas;
+        else if (priority == Priority::High)
+            threshold += _emergencyArenas;
+        return threshold;
+    }
+
+    // Returns true if the allocated address p was allocated after the given boundary was set.
+    bool allocatedAfterMark(const void* p, const Boundary& boundary)
+    {
+        SizeType arenaId = arenaIdOf(p);
+        for (SizeType i = _freeListHead; i < boundary.freeListHead; ++i)
+            if (derived()->_freeList[i] == arenaId)
+                return true;
+        // The active arenas grow downwards.
+        for (const ActiveArena& lane : boundary.active)
+            if (lane.arenaId == arenaId && p < lane.data)
+                return true;
+        return false;
+    }
+
+    // Takes note of a freed object which was allocated before the outermost marker.
+    // If the arena was active at the marker, the rollback restores its count so the free
+    // is subtracted then. Otherwise the arena was retired, and if it became vacant,
+    // it is linked to the list of arenas to be released through _bytesLeftInArena.
+    void deferPreMarkFree(SizeType arenaId, SizeType numAllocs)
+    {
+        for (std::size_t i = 0; i < numLanes; ++i) {
+            if (_outermostMark.active[i].arenaId == arenaId) {
+                ++_preMarkFrees[i];
+                return;
+            }
+        }
+        if (numAllocs == 0) {
+            derived()->_bytesLeftInArena[arenaId] = _pendingRelease;
+            _pendingRelease = arenaId;
+        }
+    }
+
+    // Recycles the arenas emptied while the outermost marker was set. Called by its rollback.
+    void recyclePreMarkFrees()
+    {
+        while (_pendingRelease != noArena) {
+            SizeType arenaId = _pendingRelease;
+            _pendingRelease = derived()->_bytesLeftInArena[arenaId];
+            derived()->_bytesLeftInArena[arenaId] = 0;
+            releaseArena(arenaId);
+        }
+        for (std::size_t i = 0; i < numLanes; ++i) {
+            ActiveArena& lane = _active[i];
+            if (_preMarkFrees[i] > 0 && allocationsInArena(lane.arenaId) == 0) {
+                if (i == reserveLane) {
+                    SizeType arenaId = lane.arenaId;
+                    lane = ActiveArena{nullptr, 0, noArena};
+                    releaseArena(arenaId);
+                }
+                else {
+                    resetActiveArena(lane);
+                }
+            }
+            _preMarkFrees[i] = 0;
+        }
+    }
+
+    // Returns true and updates the given active arena if a free arena is available.
+    // Otherwise, returns false and doesn't change anything.
+    // Note: the mutex must be locked before this function is called in synchronized mode.
+    bool reserveNextArena(ActiveArena& lane, Priority priority = Priority::Normal)
+    {
+        if (_freeListHead <= tapThreshold(priority))
+            return false;
+        if (_freeListHead <= tapThreshold(Priority::Normal))
+            ++_reserveTaps[std::size_t(priority)];
+        // Remember how much room was left in the arena which is now retired.
+        if (lane.arenaId != noArena) {
+            derived()->_bytesLeftInArena[lane.arenaId] = lane.bytesLeft;
+            ++_numArenaSwitches;
+        }
+        lane.bytesLeft = derived()->arenaSize();
+        lane.arenaId = popFreeArena();
+        // Initially, data points to one past the last byte of the arena.
+        lane.data = arenaEnd(lane.arenaId);
+        return true;
+    }
+
+    // Re-initialize an active arena in an optimized way without
+    // release/reserve cycle.
+    // Note: mutex must be locked before this function is called in synchronized mode.
+    void resetActiveArena(ActiveArena& lane)
+    {
+        MULTIARENA_ASSERT(allocationsInArena(lane.arenaId) == 0);
+        lane.bytesLeft = derived()->arenaSize();
+        lane.data = arenaEnd(lane.arenaId);
+        derived()->_numAllocationsInArena[lane.arenaId] = 0;
+    }
+
+    // Pointer to one past the last byte of the given arena.
+    std::byte* arenaEnd(SizeType arenaId)
+    {
+        return derived()->_arenaData.data() + std::size_t(derived()->arenaSize()) * (arenaId + 1);
+    }
+
+    // Id of the arena which contains the given address.
+    SizeType arenaIdOf(const void* p) const
+    {
+        uintptr_t ptrAsInteger = reinterpret_cast<uintptr_t>(p);
+        uintptr_t dataAsInteger = reinterpret_cast<uintptr_t>(derived()->_arenaData.data());
+        return SizeType((ptrAsInteger - dataAsInteger) / derived()->arenaSize());
+    }
+
+    // Returns the lifetime class whose active arena is the given one or nullptr if none.
+    ActiveArena* activeArenaOf(SizeType arenaId)
+    {
+        for (ActiveArena& lane : _active)
+            if (lane.arenaId == arenaId)
+                return &lane;
+        return nullptr;
+    }
+
+    // Pointer to the beginning of the data buffer of the given arena
+    uintptr_t arenaBegin(SizeType arenaId) const
+    {
+        return reinterpret_cast<uintptr_t>(derived()->_arenaData.data()) + std::size_t(derived()->arenaSize()) * arenaId;
+    }
+
+    // Number of arenas needed for count allocations of the given size
+    // or noArena if the allocations don't fit in the resource.
+    SizeType arenasNeeded(std::size_t bytes, std::size_t count) const
+    {
+        constexpr std::size_t binSize = alignof(std::max_align_t);
+        std::size_t numBytesNeeded = (bytes + binSize - 1) / binSize * binSize;
+        if (numBytesNeeded > derived()->arenaSize())
+            return noArena;
+        if (numBytesNeeded == 0 || count == 0)
+            return 0;
+        std::size_t allocationsPerArena = derived()->arenaSize() / numBytesNeeded;
+        std::size_t numArenas = (count + allocationsPerArena - 1) / allocationsPerArena;
+        return (numArenas <= derived()->numArenas()) ? SizeType(numArenas) : noArena;
+    }
+
+    // The allocation counter of a leased arena is biased by this much
+    // so that the arena never looks vacant while the lease is on.
+    static constexpr SizeType leaseBias = SizeType(1) << (8 * sizeof(SizeType) - 1);
+
+    // Takes a free arena out of the free list for a lease. See ArenaLease.
+    // If bReserved is true, the arena is one of the reserved arenas.
+    // Returns noArena if there are no free arenas.
+    // No arena is leased while a marker is set because the free list must not change.
+    SizeType beginLease(bool bReserved = false)
+    {
+        if (bReserved) {
+            MULTIARENA_ASSERT(_reservedArenas > 0 && _markDepth == 0);
+            --_reservedArenas;
+        }
+        else if (_markDepth > 0 || _freeListHead <= tapThreshold(Priority::Normal)) {
+            return noArena;
+        }
+        ++_numLeasedArenas;
+        SizeType arenaId = popFreeArena();
+        derived()->_numAllocationsInArena[arenaId] = leaseBias;
+        derived()->_bytesLeftInArena[arenaId] = 0; // allocateNear must not touch the arena.
+        return arenaId;
+    }
+
+    // Counts a batch of allocations made through a lease of the given arena.
+    void publishLease(SizeType arenaId, SizeType numAllocations)
+    {
+        derived()->_numAllocationsInArena[arenaId] += numAllocations;
+    }
+
+    // Ends the lease of the given arena and counts the allocations not published yet.
+    // The arena goes back to the free list if everything allocated through the lease
+    // has been freed already.
+    void endLease(SizeType arenaId, SizeType numUnpublished)
+    {
+        --_numLeasedArenas;
+        if ((derived()->_numAllocationsInArena[arenaId] += numUnpublished - leaseBias) == 0)
+            releaseArena(arenaId);
+    }
+
+    // Returns the reserved arenas which were not tapped.
+    void endReservation(SizeType numArenas)
+    {
+        MULTIARENA_ASSERT(_reservedArenas >= numArenas);
+        _reservedArenas -= numArenas;
+    }
+
+    // Recycle the given arena by moving it to the freelist.
+    // Returns true if all arenas become empty.
+    // Note: mutex must be locked before this function is called in synchronized mode.
+    void releaseArena(SizeType arenaId)
     {
         MULTIARENA_ASSERT(allocationsInArena(arenaId) == 0);
-        MULTIARENA_ASSERT(arenaId != _activeArenaId);
-        MULTIARENA_ASSERT(_freeListHead < derived()->numArenas());
-        derived()->_freeList[_freeListHead++] = arenaId;
-        derived()->_numAllocationsInArena[arenaId].reset();
+        pushFreeArena(arenaId);
+        derived()->_numAllocationsInArena[arenaId] = 0;
     }
 
 private:
@@ -558,72 +1102,65 @@ private:
         return static_cast<Derived*>(this);
     }
 
-    // Tap a new arena if there is not enough space left in the active one.
-    // Returns nullptr if all arenas are out of memory and the allocation can't hence be made.
-    // Assume that alignment is a power of 2.
-    // Also assume that the mutex locked on entry.
-    void* do_allocate_details(std::size_t bytes) noexcept
+    // Carves the block from the given arena.
+    // Returns nullptr if there is not enough space left in the arena.
+    void* bumpAllocate(std::size_t bytes, std::size_t alignment, ActiveArena& lane)
     {
-        // Is there still space in the currently active arena?
-        auto numBytesNeeded = bytesReserved() + bytes;
-        if (numBytesNeeded > derived()->arenaSize()) { // Tap a new arena.
-            if (reserveNextArena())
-                return do_allocate_details(bytes);
-            return nullptr; // We are out of arenas
-        }
+        uintptr_t ptrAsInteger = reinterpret_cast<uintptr_t>(lane.data);
+        ptrAsInteger -= bytes;  // Tentative result excluding alignment.
+        SizeType alignmentOffset = ptrAsInteger & (alignment - 1); // Assume alignment is a power of 2
+        SizeType numBytesNeeded = SizeType(bytes) + alignmentOffset; // Final amount of bytes needed
+        if (numBytesNeeded > lane.bytesLeft || bytes > lane.bytesLeft)
+            return nullptr;
+        ptrAsInteger -= alignmentOffset;
+        lane.data = reinterpret_cast<void*>(ptrAsInteger);
+        lane.bytesLeft -= numBytesNeeded;
+
         // Update the number of allocations made in the current arena.
-        derived()->_numAllocationsInArena[_activeArenaId].allocations.fetch_add(1, std::memory_order_relaxed);
-        return  reinterpret_cast<void*>(_data.fetch_add(bytes, std::memory_order_relaxed));
+        ++(derived()->_numAllocationsInArena[lane.arenaId]);
+        return lane.data;
     }
 
-protected:
-    // Returns pointer to a block of data whose size it at least bytes
-    // and which is aligned to alignof(max_align_t).
-    // So the alignment argument is ignored.
-    void* do_allocate(std::size_t bytes, std::size_t) override
+    // Returns nullptr if all arenas are out of memory and the allocation can't hence be made.
+    void* do_allocate_details(std::size_t bytes, std::size_t alignment, ActiveArena& lane, Priority priority)
     {
-        if (bytes == 0)
+        if (void* result = bumpAllocate(bytes, alignment, lane))
+            return result;
+        // Not enough space in this arena. Tap the next one.
+        if (bytes <= derived()->arenaSize() && reserveNextArena(lane, priority))
+            // There is enough space in the next arena so the recursion will occur only once.
+            return do_allocate_details(bytes, alignment, lane, priority);
+        else  // Out of luck. bad_alloc will be thrown if exceptions are enabled.
             return nullptr;
-        // Assume that _bytesReserved is divisible by alignof(max_align_t) (== usually 16)
-        // and the arena is split into bins of size binSize.
-        constexpr std::size_t binSize = alignof(max_align_t);
+    }
 
-        // How many bins are needed for data?
-        std::size_t numBinsForData = (bytes + binSize - 1) / binSize;
-        // Calculate how many bytes will be reserved from the active arena, including alignment to binSize.
-        uintptr_t numBytesNeeded = numBinsForData * binSize;
-        if (numBytesNeeded > derived()->arenaSize()) // Too large request
+    void* allocateFromLane(ActiveArena& lane, std::size_t bytes, std::size_t alignment,
+                           Priority priority = Priority::Normal)
+    {
+        if (bytes == 0)
             return nullptr;
-
-        void* result;
-        _mtx.lock_shared();
-        // Increment the data pointer and see if we are still within the active arena.
-        // Note that the active arena can not change because of the shared lock.
-        auto prevData =_data.fetch_add(numBytesNeeded, std::memory_order_relaxed);
-        // Does the allocated block extend past the end of the buffer?
-        bool bAllocationOk = (prevData + numBytesNeeded) < arenaBegin(_activeArenaId + 1);
-        if (bAllocationOk) { // The allocation still fits in the active arena
-            derived()->_numAllocationsInArena[_activeArenaId].allocations.fetch_add(1, std::memory_order_relaxed);
-            result = reinterpret_cast<void*>(prevData);
-        }
-        _mtx.unlock_shared();
-        if (!bAllocationOk) { // The allocation does not fit in the active arena, so change the arena.
-            _mtx.lock();
-            result = do_allocate_details(numBytesNeeded);
-            _mtx.unlock();
-
-            if constexpr (exceptionsEnabled) {
-                if (result == nullptr) { // Find out the reason for failure.
-                    if (numBytesNeeded > derived()->arenaSize()) // Too large block requested
-                        throw AllocateTooLargeBlock(bytes, derived()->arenaSize());
-                    else
-                        throw OutOfFreeArenas(derived()->numArenas());
-                }
+        void* result = do_allocate_details(bytes, alignment, lane, priority);
+        // Out of free arenas? Let the handler make room and retry.
+        for (SizeType retry = 0; result == nullptr && bytes <= derived()->arenaSize() && retry < _maxRetries &&
+                                 _outOfArenasHandler && _outOfArenasHandler(bytes, _outOfArenasContext); ++retry)
+            result = do_allocate_details(bytes, alignment, lane, priority);
+        if constexpr (exceptionsEnabled) {
+            if (result == nullptr) { // Find out the reason for failure.
+                if (bytes > derived()->arenaSize()) // Too large block requested
+                    throw AllocateTooLargeBlock(bytes, derived()->arenaSize());
+                else
+                    throw OutOfFreeArenas(derived()->numArenas());
             }
         }
         return result;
     }
 
+protected:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        return allocateFromLane(_active[0], bytes, alignment);
+    }
+
     // Virtual allocate function.
     // Note that bytes and alignment are used only when an exception is thrown
     // so they are actually only debug helpers and may be left out.
@@ -634,31 +1171,30 @@ protected:
         if (p == nullptr)
             return;
         // Calculate the id of the arena where the address has come from.
-        uintptr_t ptrAsInteger = reinterpret_cast<uintptr_t>(p);
-        uintptr_t dataAsInteger = reinterpret_cast<uintptr_t>(derived()->_arenaData.data());
-        SizeType arenaId = SizeType(ptrAsInteger - dataAsInteger) / derived()->arenaSize();
+        SizeType arenaId = arenaIdOf(p);
         if constexpr (exceptionsEnabled) {
             if (arenaId >= derived()->numArenas()) // There is either double-free or memory corruption
                 throw ArenaMemoryResourceCorruption(p, bytes, alignment);
         }
+        SizeType numAllocs = --(derived()->_numAllocationsInArena[arenaId]);
+        // Nothing is recycled while a marker is set because rollback can't undo it.
+        if (_markDepth > 0) {
+            if (!allocatedAfterMark(p, _outermostMark))
+                deferPreMarkFree(arenaId, numAllocs);
+            return;
+        }
         // Did the arena become vacant? If so, either reuse or release.
-        AllocationCounter& counter = derived()->_numAllocationsInArena[arenaId];
-        SizeType numDeallocs = counter.deallocations.fetch_add(1, std::memory_order_relaxed) + 1;
-        SizeType numAllocs = counter.allocations.load(std::memory_order_relaxed);
-        if (numAllocs == numDeallocs) {
-            // Lock and double check.
-            const std::lock_guard<std::shared_mutex> lock(_mtx);
-            const AllocationCounter& constCounter = derived()->_numAllocationsInArena[arenaId];
-            MULTIARENA_ASSERT(constCounter.allocations >= constCounter.deallocations);
-            bool arenaIsVacant = (numAllocs == constCounter.allocations.load(std::memory_order_relaxed)) &&
-                                 (numAllocs == constCounter.deallocations.load(std::memory_order_relaxed));
-            if (arenaIsVacant) {
-                if (arenaId == _activeArenaId)
-                    resetActiveArena(); // The currently active arena became empty so reuse it.
-                else
-                    releaseArena(arenaId); // Release the arena back to the free list.
+        if (numAllocs == 0) {
+            ActiveArena* lane = activeArenaOf(arenaId);
+            if (lane == &_active[reserveLane]) { // A reserve arena is given back as soon as it is vacant.
+                *lane = ActiveArena{nullptr, 0, noArena};
+                lane = nullptr;
             }
-        } // Release the lock
+            if (lane)
+                resetActiveArena(*lane); // An active arena became empty so reuse it.
+            else
+                releaseArena(arenaId); // Release the arena back to the free list.
+        }
     }
 
     bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
@@ -669,23 +1205,25 @@ protected:
     // Number of currently active allocation in the given arena.
     SizeType allocationsInArena(SizeType arenaId) const
     {
-        const AllocationCounter& counter = derived()->_numAllocationsInArena[arenaId];
-        MULTIARENA_ASSERT(counter.allocations >= counter.deallocations);
-        return counter.allocations - counter.deallocations;
+        SizeType allocations = derived()->_numAllocationsInArena[arenaId];
+        // The allocations of a leased arena are counted in batches, so the frees
+        // made during the lease may take the counter below the bias.
+        if (allocations >= leaseBias / 2) // Leased arena?
+            return (allocations > leaseBias) ? allocations - leaseBias : 0;
+        return allocations;
     }
-}; // SynchronizedArenaResourceBase
+}; // UnsynchronizedArenaResourceBase
 
 
-// Synchronized (i.e. thread-safe) memory resource where the data
-// is allocated from the  stack.
+// Unsynchronized (i.e. non-thread-safe) memory resource where the data
+// is allocated from the stack.
 template <SizeType NUM_ARENAS, SizeType ARENA_SIZE>
-class SynchronizedArenaResource :
-    public SynchronizedArenaResourceBase<SynchronizedArenaResource<NUM_ARENAS, ARENA_SIZE>>
+class UnsynchronizedArenaResource :
+    public UnsynchronizedArenaResourceBase<UnsynchronizedArenaResource<NUM_ARENAS, ARENA_SIZE>>
 {
 public:
-    using Base = SynchronizedArenaResourceBase<SynchronizedArenaResource<NUM_ARENAS, ARENA_SIZE>>;
-    explicit SynchronizedArenaResource(SizeType = 0, SizeType = 0)
-        noexcept(!exceptionsEnabled) : Base(NUM_ARENAS, ARENA_SIZE)
+    using Base = UnsynchronizedArenaResourceBase<UnsynchronizedArenaResource<NUM_ARENAS, ARENA_SIZE>>;
+    explicit UnsynchronizedArenaResource(SizeType = 0, SizeType = 0, std::pmr::memory_resource* = nullptr) : Base(NUM_ARENAS, ARENA_SIZE)
     {
         static_assert(NUM_ARENAS > 0, "There must be at least one arena.");
         static_assert(ARENA_SIZE % alignof(std::max_align_t) == 0," Arena size must be divisible by max alignment.");
@@ -695,56 +1233,2225 @@ public:
     constexpr SizeType numArenas() const { return NUM_ARENAS; }
     constexpr SizeType arenaSize() const { return ARENA_SIZE; }
 
-    friend class SynchronizedArenaResourceBase<SynchronizedArenaResource<NUM_ARENAS, ARENA_SIZE>>;
+    friend class UnsynchronizedArenaResourceBase<UnsynchronizedArenaResource<NUM_ARENAS, ARENA_SIZE>>;
+    friend typename Base::FreeList;
 protected:
-
-    // Number of allocations and deallocations done in each arena since the arena was activated.
-    alignas(hardware_constructive_interference_size) std::array<AllocationCounter, NUM_ARENAS> _numAllocationsInArena;
+    // Number of allocations in each arena since the arena was activated.
+    std::array<SizeType, NUM_ARENAS> _numAllocationsInArena;
+    // Number of free bytes below the allocation frontier of each retired arena.
+    std::array<SizeType, NUM_ARENAS> _bytesLeftInArena;
     // List of free arenas.
     std::array<SizeType, NUM_ARENAS> _freeList;
+    // Bitmap of free arenas.
+    std::array<uint64_t, (NUM_ARENAS + bitsPerWord - 1) / bitsPerWord> _freeBitmap;
     alignas(hardware_constructive_interference_size) // Align to a cache line.
-        std::array<std::byte, NUM_ARENAS * ARENA_SIZE> _arenaData;
-};  // SynchronizedArenaResource in stack
-
+        std::array<std::byte, ARENA_SIZE * NUM_ARENAS> _arenaData;
+};  // UnsynchronizedArenaResource in stack
 
-// Synchronized (i.e. thread-safe) memory resource where the data
+// Unsynchronized (i.e. non-thread-safe) memory resource where the data
 // is allocated from the given memory resource (system heap by default.)
 template <>
-class SynchronizedArenaResource<0, 0> :
-    public SynchronizedArenaResourceBase<SynchronizedArenaResource<0, 0>>
+class UnsynchronizedArenaResource<0, 0> :
+    public UnsynchronizedArenaResourceBase<UnsynchronizedArenaResource<0, 0>>
+{
+public:
+    using Base = UnsynchronizedArenaResourceBase<UnsynchronizedArenaResource<0, 0>>;
+    explicit UnsynchronizedArenaResource(SizeType numArenas, SizeType arenaSize, std::pmr::memory_resource* mr = nullptr)
+        : Base(numArenas, arenaSize), _numArenas(numArenas), _arenaSize(arenaSize)
+    {
+        assert(numArenas > 0);
+        assert(arenaSize % alignof(std::max_align_t) == 0);
+        if (!mr)
+            mr = std::pmr::new_delete_resource();
+
+        // Allocate arenas using the given memory resource.
+        constructPmrContainerAt(&_numAllocationsInArena, mr, numArenas);
+        constructPmrContainerAt(&_bytesLeftInArena, mr, numArenas);
+        constructPmrContainerAt(&_freeList, mr, numArenas);
+        constructPmrContainerAt(&_freeBitmap, mr, (numArenas + bitsPerWord - 1) / bitsPerWord);
+        constructPmrContainerAt(&_arenaData, mr, numArenas * arenaSize, std::byte{});
+
+        this->initializeArenas();
+    }
+
+    SizeType numArenas() const { return _numArenas; }
+    SizeType arenaSize() const { return _arenaSize; }
+
+    friend class UnsynchronizedArenaResourceBase<UnsynchronizedArenaResource<0, 0>>;
+    friend Base::FreeList;
+
+protected:
+    // Number of allocations in each arena since the arena was activated.
+    std::pmr::vector<SizeType> _numAllocationsInArena;
+    // Number of free bytes below the allocation frontier of each retired arena.
+    std::pmr::vector<SizeType> _bytesLeftInArena;
+    // List of free arenas.
+    std::pmr::vector<SizeType> _freeList;
+    // Bitmap of free arenas.
+    std::pmr::vector<uint64_t> _freeBitmap;
+    std::pmr::vector<std::byte> _arenaData;
+
+    SizeType _numArenas;  // Number of arenas.
+    SizeType _arenaSize;  // Size of each arena in bytes.
+};  // UnsynchronizedArenaResource in heap
+
+// Sets a marker when constructed and rolls the resource back to it when destroyed.
+// Example: { RollbackScope scope(arenaResource); ...temporary allocations... }
+template <class Resource>
+class RollbackScope
+{
+public:
+    explicit RollbackScope(Resource& resource) : _resource(resource), _marker(resource.mark())
+    {}
+
+    ~RollbackScope()
+    {
+        _resource.rollback(_marker);
+    }
+
+    RollbackScope(const RollbackScope&) = delete;
+    RollbackScope& operator=(const RollbackScope&) = delete;
+
+private:
+    Resource& _resource;
+    typename Resource::Marker _marker;
+};
+
+// Unsynchronized memory resource owned by one thread which may be freed into by any thread.
+// Only the owner thread may allocate. The owner frees directly into its arenas like with
+// UnsynchronizedArenaResource. The other threads push the blocks to a lock-free list
+// which the owner drains when it next allocates, so a cross-thread free is a single
+// compare-and-swap and never touches the allocation counters of the arenas.
+// The owner is the thread which constructed the resource unless changed with setOwner().
+// release() discards the blocks pending in the list because their arenas are reinitialized,
+// and rollback() drains the list first so that no block is freed into the restored arenas.
+// Both must be called only by the owner.
+template <SizeType NUM_ARENAS = 0, SizeType ARENA_SIZE = 0>
+class OwnedArenaResource : public UnsynchronizedArenaResource<NUM_ARENAS, ARENA_SIZE>
+{
+public:
+    using Base = UnsynchronizedArenaResource<NUM_ARENAS, ARENA_SIZE>;
+    using Base::Base;
+
+    ~OwnedArenaResource()
+    {
+        drainRemoteFrees();
+    }
+
+    // Makes the calling thread the owner.
+    void setOwner()
+    {
+        _owner.store(std::this_thread::get_id(), std::memory_order_relaxed);
+    }
+
+    bool isOwner() const
+    {
+        return _owner.load(std::memory_order_relaxed) == std::this_thread::get_id();
+    }
+
+    // Returns the blocks freed by other threads to the arenas.
+    // Must be called only by the owner.
+    void drainRemoteFrees()
+    {
+        if (_remoteFrees.load(std::memory_order_relaxed) == nullptr)
+            return;
+        void* p = _remoteFrees.exchange(nullptr, std::memory_order_acquire);
+        while (p != nullptr) {
+            void* next = *static_cast<void**>(p);
+            Base::do_deallocate(p, sizeof(void*), alignof(void*));
+            p = next;
+        }
+    }
+
+    // Like UnsynchronizedArenaResource::release. The blocks freed by other threads
+    // and not yet drained were released too, so they are dropped.
+    void release()
+    {
+        MULTIARENA_ASSERT(isOwner());
+        _remoteFrees.store(nullptr, std::memory_order_relaxed);
+        Base::release();
+    }
+
+    // Like UnsynchronizedArenaResource::rollback. The blocks freed by other threads
+    // are drained before the allocation counts are restored.
+    void rollback(const typename Base::Marker& marker)
+    {
+        MULTIARENA_ASSERT(isOwner());
+        drainRemoteFrees();
+        Base::rollback(marker);
+    }
+
+    // The allocating functions of the base class round every block up to hold and align
+    // the link of the remote free list.
+    void* allocateFor(Lifetime lifetime, std::size_t bytes, std::size_t alignment = alignof(std::max_align_t))
+    {
+        MULTIARENA_ASSERT(isOwner());
+        drainRemoteFrees();
+        return Base::allocateFor(lifetime, linkBytes(bytes), linkAlignment(alignment));
+    }
+
+    void* allocateNear(const void* p, std::size_t bytes, std::size_t alignment = alignof(std::max_align_t))
+    {
+        MULTIARENA_ASSERT(isOwner());
+        drainRemoteFrees();
+        return Base::allocateNear(p, linkBytes(bytes), linkAlignment(alignment));
+    }
+
+    AllocationResult allocateAtLeast(std::size_t bytes, std::size_t alignment = alignof(std::max_align_t))
+    {
+        MULTIARENA_ASSERT(isOwner());
+        drainRemoteFrees();
+        return Base::allocateAtLeast(linkBytes(bytes), linkAlignment(alignment));
+    }
+
+    void* allocateWithPriority(Priority priority, std::size_t bytes, std::size_t alignment = alignof(std::max_align_t))
+    {
+        MULTIARENA_ASSERT(isOwner());
+        drainRemoteFrees();
+        return Base::allocateWithPriority(priority, linkBytes(bytes), linkAlignment(alignment));
+    }
+
+protected:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        MULTIARENA_ASSERT(isOwner());
+        drainRemoteFrees();
+        return Base::do_allocate(linkBytes(bytes), linkAlignment(alignment));
+    }
+
+    void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override
+    {
+        if (p == nullptr)
+            return;
+        if (isOwner()) {
+            Base::do_deallocate(p, bytes, alignment);
+            return;
+        }
+        // Every block is rounded up to hold an aligned link so the link is stored in the block.
+        void* head = _remoteFrees.load(std::memory_order_relaxed);
+        do {
+            *static_cast<void**>(p) = head;
+        } while (!_remoteFrees.compare_exchange_weak(head, p, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+private:
+    static constexpr std::size_t linkBytes(std::size_t bytes)
+    {
+        return (bytes + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+    }
+
+    static constexpr std::size_t linkAlignment(std::size_t alignment)
+    {
+        return std::max(alignment, alignof(void*));
+    }
+
+    std::atomic<std::thread::id> _owner {std::this_thread::get_id()};
+    std::atomic<void*> _remoteFrees {nullptr}; // Blocks freed by other threads.
+};
+
+#if MULTIARENA_PROFILE
+// Snapshot of the contention profile of a synchronized resource.
+struct ContentionStatistics
+{
+    struct LockStatistics
+    {
+        std::size_t numAcquisitions = 0;
+        std::chrono::nanoseconds totalWaitTime {0}; // Time spent waiting for the lock.
+    };
+    LockStatistics sharedLocks;  // Shared locks taken on the allocation fast path.
+    LockStatistics switchLocks;  // Exclusive locks taken to switch the active arena.
+    LockStatistics recycleLocks; // Locks taken to recycle a vacant arena.
+    LockStatistics leaseLocks;   // Exclusive locks taken to lease, reserve or release arenas.
+    std::size_t numFailedFits = 0; // Allocations which did not fit in the active arena.
+};
+
+// Counters of the contention profiler. Each thread is given the next slot in turn, so up to
+// numSlots threads never share a slot. The counters are atomic because further threads do.
+class ContentionProfiler
+{
+public:
+    enum Event { SharedLock, SwitchLock, RecycleLock, LeaseLock, numEvents };
+
+    void recordLock(Event event, std::chrono::nanoseconds waitTime)
+    {
+        Slot& slot = threadSlot();
+        slot.numAcquisitions[event].fetch_add(1, std::memory_order_relaxed);
+        slot.waitTime[event].fetch_add(uint64_t(waitTime.count()), std::memory_order_relaxed);
+    }
+
+    void recordFailedFit()
+    {
+        threadSlot().numFailedFits.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Sums up the slots. Only a snapshot if other threads are active.
+    ContentionStatistics snapshot() const
+    {
+        ContentionStatistics result;
+        ContentionStatistics::LockStatistics* locks[numEvents] = {&result.sharedLocks, &result.switchLocks,
+                                                                  &result.recycleLocks, &result.leaseLocks};
+        for (const Slot& slot : _slots) {
+            for (int event = 0; event < numEvents; ++event) {
+                locks[event]->numAcquisitions += slot.numAcquisitions[event].load(std::memory_order_relaxed);
+                locks[event]->totalWaitTime += std::chrono::nanoseconds(slot.waitTime[event].load(std::memory_order_relaxed));
+            }
+            result.numFailedFits += slot.numFailedFits.load(std::memory_order_relaxed);
+        }
+        return result;
+    }
+
+    void reset()
+    {
+        for (Slot& slot : _slots) {
+            for (int event = 0; event < numEvents; ++event) {
+                slot.numAcquisitions[event].store(0, std::memory_order_relaxed);
+                slot.waitTime[event].store(0, std::memory_order_relaxed);
+            }
+            slot.numFailedFits.store(0, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    static constexpr std::size_t numSlots = 64;
+
+    struct alignas(hardware_constructive_interference_size) Slot
+    {
+        std::atomic<uint64_t> numAcquisitions[numEvents] = {};
+        std::atomic<uint64_t> waitTime[numEvents] = {}; // In nanoseconds.
+        std::atomic<uint64_t> numFailedFits = 0;
+    };
+
+    // The slot index of a thread is the same for every profiler.
+    Slot& threadSlot()
+    {
+        static std::atomic<std::size_t> nextIndex = 0;
+        static thread_local const std::size_t index = nextIndex.fetch_add(1, std::memory_order_relaxed) % numSlots;
+        return _slots[index];
+    }
+
+    std::array<Slot, numSlots> _slots;
+};
+#endif
+
+// The numbers of allocations and deallocations made in an arena packed into one
+// atomic word. Each update returns both numbers so exactly one deallocation sees
+// the arena become vacant, and a vacant arena can be claimed with a single CAS.
+struct AllocationCounter
+{
+    using CountType = uint32_t;
+    static constexpr uint64_t oneAllocation = uint64_t(1) << 32;
+    static constexpr uint64_t oneDeallocation = 1;
+
+    static constexpr CountType allocations(uint64_t counts) { return CountType(counts >> 32); }
+    static constexpr CountType deallocations(uint64_t counts) { return CountType(counts); }
+    static constexpr uint64_t pack(CountType allocations, CountType deallocations)
+    {
+        return (uint64_t(allocations) << 32) | deallocations;
+    }
+
+    std::atomic<uint64_t> counts = 0;
+    void reset()
+    {
+        counts.store(0, std::memory_order_relaxed);
+    }
+};
+
+// Forward declarations of memory resource classes.
+template <SizeType NUM_ARENAS = 0, SizeType ARENA_SIZE = 0>
+class SynchronizedArenaResource;
+
+// Base class for all variants of synchronized polymorphic memory resources.
+template <class Derived>
+class SynchronizedArenaResourceBase : public std::pmr::memory_resource,
+                                      public FreeArenaList<Derived, AtomicFreeArenaStorage>
+{
+protected:
+    using FreeList = FreeArenaList<Derived, AtomicFreeArenaStorage>;
+    using FreeList::_freeListHead;
+    using FreeList::_policy;
+    using FreeList::popFreeArena;
+    using FreeList::pushFreeArena;
+    using FreeList::convertFreeList;
+
+public:
+    SynchronizedArenaResourceBase(SizeType /*numArenas*/, SizeType /*arenaSize*/)
+    {}
+
+    // Total number of allocations combined in all arenas.
+    std::size_t numberOfAllocations()
+    {
+        const std::lock_guard<std::shared_mutex> lock(_mtx);
+        std::size_t result = 0;
+        for (SizeType i = 0; i < derived()->numArenas(); ++i)
+            result += allocationsInArena(i);
+        return result;
+    }
+
+    // Number of non-empty arenas.
+    SizeType numberOfBusyArenas()
+    {
+        const std::lock_guard<std::shared_mutex> lock(_mtx);
+        auto result = derived()->numArenas() - _freeListHead;
+        // The active arenas are counted as a busy even if there
+        // are no allocations yet so we must check if they are actually empty.
+        for (const ActiveArena& lane : _active)
+            if (lane.arenaId != noArena && allocationsInArena(lane.arenaId) == 0)
+                --result;
+        return result;
+    }
+
+    // Returns true if the given address lies within the arenas of this resource.
+    bool contains(const void* p) const
+    {
+        uintptr_t ptrAsInteger = reinterpret_cast<uintptr_t>(p);
+        return ptrAsInteger >= arenaBegin(0) &&
+               ptrAsInteger - arenaBegin(0) < std::size_t(derived()->numArenas()) * derived()->arenaSize();
+    }
+
+    // Allocates from the active arena of the given lifetime class.
+    // Objects of different lifetime classes never share an arena.
+    void* allocateFor(Lifetime lifetime, std::size_t bytes, std::size_t = alignof(std::max_align_t))
+    {
+        return allocateFromLane(_active[std::size_t(lifetime)], bytes);
+    }
+
+    // Allocates at least the given number of bytes and returns the pointer together with the number
+    // of bytes actually allocated. If the rest of the active arena would be too small for another
+    // block of the same size, the whole rest is handed out so that it isn't wasted.
+    // The block is aligned to alignof(max_align_t) so the alignment argument is ignored.
+    AllocationResult allocateAtLeast(std::size_t bytes, std::size_t = alignof(std::max_align_t))
+    {
+        if (bytes == 0)
+            return {nullptr, 0};
+        constexpr std::size_t binSize = alignof(max_align_t);
+        std::size_t numBytesNeeded = (bytes + binSize - 1) / binSize * binSize;
+        ActiveArena& lane = _active[0];
+        {
+            const auto lock = lockForAllocation();
+            uintptr_t prevData = lane.data.load(std::memory_order_relaxed);
+            if (prevData < lane.end) {
+                std::size_t tail = lane.end - prevData;
+                if (tail >= numBytesNeeded && tail - numBytesNeeded < numBytesNeeded &&
+                    lane.data.compare_exchange_strong(prevData, lane.end, std::memory_order_relaxed)) {
+                    derived()->_numAllocationsInArena[lane.arenaId].counts.fetch_add(AllocationCounter::oneAllocation, std::memory_order_relaxed);
+                    return {reinterpret_cast<void*>(prevData), tail};
+                }
+            }
+        }
+        return {allocateFromLane(lane, bytes), numBytesNeeded};
+    }
+
+    // Leases a free arena for the exclusive use of the calling thread.
+    // The lease is an unsynchronized memory resource. See ArenaLease.
+    ArenaLease<Derived> leaseArena()
+    {
+        return ArenaLease<Derived>(*derived());
+    }
+
+    // Returns a buffer through which the calling thread allocates from slices of sliceSize
+    // bytes carved from the active arena. See ThreadAllocationBuffer.
+    ThreadAllocationBuffer<Derived> threadAllocationBuffer(SizeType sliceSize = 4096)
+    {
+        return ThreadAllocationBuffer<Derived>(*derived(), sliceSize);
+    }
+
+    // Sets the handler which is called when the resource runs out of free arenas.
+    // The allocation is retried after each call at most maxRetries times.
+    // Set handler to nullptr to fail immediately, which is the default.
+    // The handler is called without holding any locks.
+    void setOutOfArenasHandler(OutOfArenasHandler handler, void* context = nullptr, SizeType maxRetries = 3)
+    {
+        const std::lock_guard<std::shared_mutex> lock(_mtx);
+        _outOfArenasHandler = handler;
+        _outOfArenasContext = context;
+        _maxRetries = maxRetries;
+    }
+
+    // Sets the handler which is called after an arena has been released or an active arena
+    // has become vacant. Set handler to nullptr to remove it. There is one handler per resource.
+    // The handler is called without holding any locks. See ArenaReleasedHandler.
+    void setArenaReleasedHandler(ArenaReleasedHandler handler, void* context = nullptr)
+    {
+        _arenaReleasedContext.store(context, std::memory_order_relaxed);
+        _arenaReleasedHandler.store(handler, std::memory_order_release);
+    }
+
+    // Allocates like allocate() but returns nullptr instead of throwing if the block does not
+    // fit in an arena or the resource is out of free arenas. The out-of-arenas handler is not called.
+    void* tryAllocate(std::size_t bytes)
+    {
+        constexpr std::size_t binSize = alignof(max_align_t);
+        uintptr_t numBytesNeeded = (bytes + binSize - 1) / binSize * binSize;
+        if (bytes == 0 || numBytesNeeded > derived()->arenaSize())
+            return nullptr;
+        ActiveArena& lane = _active[0];
+        void* result = allocateFromActiveArena(lane, numBytesNeeded);
+        if (result == nullptr) {
+            profileFailedFit();
+            const auto lock = lockForSwitch();
+            result = do_allocate_details(numBytesNeeded, lane, Priority::Normal);
+        }
+        return result;
+    }
+
+    // Keeps the given numbers of free arenas in reserve. Normal priority allocations
+    // can't tap the reserve arenas, high priority allocations can tap the high priority
+    // reserve and emergency allocations can tap every free arena.
+    void setReserveArenas(SizeType highPriorityArenas, SizeType emergencyArenas)
+    {
+        const std::lock_guard<std::shared_mutex> lock(_mtx);
+        _highPriorityArenas = highPriorityArenas;
+        _emergencyArenas = emergencyArenas;
+    }
+
+    // Allocates with the given priority. High priority and emergency allocations are made
+    // from the default active arena as long as it can tap arenas outside the reserve.
+    // After that, they tap the reserve arenas into a lane of their own so that normal
+    // allocations never fill a reserve arena.
+    void* allocateWithPriority(Priority priority, std::size_t bytes, std::size_t = alignof(std::max_align_t))
+    {
+        if (priority != Priority::Normal && bytes > 0) {
+            constexpr std::size_t binSize = alignof(max_align_t);
+            uintptr_t numBytesNeeded = (bytes + binSize - 1) / binSize * binSize;
+            if (numBytesNeeded <= derived()->arenaSize()) {
+                void* result = allocateFromActiveArena(_active[0], numBytesNeeded);
+                if (result == nullptr) {
+                    const auto lock = lockForSwitch();
+                    result = do_allocate_details(numBytesNeeded, _active[0], Priority::Normal);
+                }
+                if (result != nullptr)
+                    return result;
+            }
+            return allocateFromLane(_active[reserveLane], bytes, priority);
+        }
+        return allocateFromLane(_active[0], bytes);
+    }
+
+    // Like allocate but if the resource is out of free arenas, waits until another
+    // thread releases an arena or the timeout expires. Waiting costs nothing as long
+    // as there are free arenas. The timeout must be finite.
+    // Throws OutOfFreeArenas or returns nullptr if the timeout expires.
+    template <class Rep, class Period>
+    void* allocateWait(std::size_t bytes, std::size_t /*alignment*/, const std::chrono::duration<Rep, Period>& timeout)
+    {
+        if (bytes == 0)
+            return nullptr;
+        constexpr std::size_t binSize = alignof(max_align_t);
+        uintptr_t numBytesNeeded = (bytes + binSize - 1) / binSize * binSize;
+        if (numBytesNeeded > derived()->arenaSize()) { // Too large request
+            if constexpr (exceptionsEnabled)
+                throw AllocateTooLargeBlock(bytes, derived()->arenaSize());
+            return nullptr;
+        }
+        ActiveArena& lane = _active[0];
+        void* result = allocateFromActiveArena(lane, numBytesNeeded);
+        if (result == nullptr) {
+            profileFailedFit();
+            auto lock = lockForSwitch();
+            result = do_allocate_details(numBytesNeeded, lane, Priority::Normal);
+            if (result == nullptr) { // Out of free arenas so wait until one is released.
+                auto start = std::chrono::steady_clock::now();
+                auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout);
+                ++_numWaiters;
+                while (result == nullptr) {
+                    bool bTimeout = (_arenaReleased.wait_until(lock, deadline) == std::cv_status::timeout);
+                    result = do_allocate_details(numBytesNeeded, lane, Priority::Normal);
+                    if (bTimeout)
+                        break;
+                }
+                --_numWaiters;
+                auto waitTime = std::chrono::steady_clock::now() - start;
+                ++_waitStatistics.numWaits;
+                _waitStatistics.numTimeouts += (result == nullptr);
+                _waitStatistics.totalWaitTime += waitTime;
+                _waitStatistics.maxWaitTime = std::max<std::chrono::nanoseconds>(_waitStatistics.maxWaitTime, waitTime);
+            }
+        }
+        if constexpr (exceptionsEnabled) {
+            if (result == nullptr)
+                throw OutOfFreeArenas(derived()->numArenas());
+        }
+        return result;
+    }
+
+    // Statistics of the waits in allocateWait.
+    struct WaitStatistics
+    {
+        std::size_t numWaits = 0;    // Number of allocations which had to wait for a free arena.
+        std::size_t numTimeouts = 0; // Number of waits which timed out.
+        std::chrono::nanoseconds totalWaitTime {0};
+        std::chrono::nanoseconds maxWaitTime {0};
+    };
+
+    WaitStatistics waitStatistics()
+    {
+        const std::lock_guard<std::shared_mutex> lock(_mtx);
+        return _waitStatistics;
+    }
+
+#if MULTIARENA_PROFILE
+    // Lock acquisitions, lock wait times and failed fits so far.
+    ContentionStatistics contentionStatistics() const { return _profiler.snapshot(); }
+
+    void resetContentionStatistics() { _profiler.reset(); }
+#endif
+
+    // Number of times an allocation of the given priority has tapped a reserve arena.
+    SizeType numberOfReserveTaps(Priority priority)
+    {
+        const std::lock_guard<std::shared_mutex> lock(_mtx);
+        return _reserveTaps[std::size_t(priority)];
+    }
+
+    // Number of times an active arena has been replaced with a free arena.
+    std::size_t numberOfArenaSwitches()
+    {
+        const std::lock_guard<std::shared_mutex> lock(_mtx);
+        return _numArenaSwitches;
+    }
+
+    // Sets aside enough whole arenas for count allocations of at most the given size
+    // each and returns them as a reservation. Allocations made through the reservation
+    // are guaranteed to succeed until the reserved space runs out. The arenas which were
+    // not tapped are returned to the resource when the reservation is released.
+    // If there are not enough free arenas or nothing is reserved (i.e. bytes or count is zero),
+    // the returned reservation is not valid().
+    // The reservation is a lease which holds the reserved arenas.
+    ArenaLease<Derived> reserve(std::size_t bytes, std::size_t count)
+    {
+        SizeType numArenas = arenasNeeded(bytes, count);
+        if (numArenas == 0 || numArenas == noArena)
+            return ArenaLease<Derived>();
+        {
+            const auto lock = lockForLease();
+            if (_freeListHead < tapThreshold(Priority::Normal) + numArenas)
+                return ArenaLease<Derived>();
+            _reservedArenas += numArenas;
+        }
+        return ArenaLease<Derived>(*derived(), numArenas);
+    }
+
+    // Number of free arenas set aside for reservations.
+    SizeType numberOfReservedArenas()
+    {
+        const std::lock_guard<std::shared_mutex> lock(_mtx);
+        return _reservedArenas;
+    }
+
+    // Releases all allocations at once and returns every arena to the free list
+    // like std::pmr::monotonic_buffer_resource::release. The objects are not deallocated
+    // one by one so the caller must make sure that none of them is used after the call.
+    // The cost is proportional to the number of arenas, not to the number of allocations.
+    // No other thread may use the resource during the call. No arena may be leased or
+    // reserved and no thread allocation buffer may hold a slice, because returning it
+    // afterwards would take its charge from a counter which has been reset.
+    // Call release() of each ThreadAllocationBuffer first.
+    void release()
+    {
+        {
+            const auto lock = lockForLease();
+#if MULTIARENA_DEBUG
+            std::size_t n = 0;
+            for (SizeType i = 0; i < derived()->numArenas(); ++i)
+                n += allocationsInArena(i);
+            if (n > 0)
+                atomicPrint("release: ", n, " allocations outstanding in ", derived()->numArenas() - _freeListHead, " arenas.\n");
+#endif
+            initializeArenas();
+            notifyWaiters();
+        }
+        notifyArenaReleased();
+    }
+
+    // Sets the order in which free arenas are tapped. See ArenaSelectionPolicy.
+    void setArenaSelectionPolicy(ArenaSelectionPolicy policy)
+    {
+        const std::lock_guard<std::shared_mutex> lock(_mtx);
+        if (policy != _policy)
+            convertFreeList(policy);
+    }
+
+    template <class Resource>
+    friend class ArenaLease;
+
+    template <class Resource>
+    friend class ThreadAllocationBuffer;
+
+protected:
+    void initializeArenas()
+    {
+        for (SizeType i = 0; i < derived()->numArenas(); ++i)
+            derived()->_numAllocationsInArena[i].reset();
+        _reservedArenas = 0;
+        this->initializeFreeList();
+        // The lifetime classes tap their first arena on demand.
+        for (ActiveArena& lane : _active) {
+            lane.data = 0;
+            lane.end = 0;
+            lane.arenaId = noArena;
+        }
+        // Activate the first arena. Al least one arena must be active at all times.
+        reserveNextArena(_active[0], Priority::Emergency);
+    }
+
+    // Id of an arena which does not exist.
+    static constexpr SizeType noArena = ~SizeType(0);
+
+    // The lifetime classes have a lane each and the reserve arenas have a lane of their own.
+    static constexpr std::size_t numLanes = numLifetimes + 1;
+    static constexpr std::size_t reserveLane = numLifetimes;
+
+    // State of the arena which is currently active for a lifetime class.
+    // Each one lives in its own cache line so that the lifetime classes do not contend.
+    struct alignas(hardware_constructive_interference_size) ActiveArena
+    {
+        std::atomic<uintptr_t> data; // Pointer to the next free address within the arena.
+        uintptr_t end;               // One past the last byte of the arena.
+        SizeType arenaId;            // Id of the arena or noArena if the lifetime class has not tapped one yet.
+    };
+
+    // One active arena per lane. The first one is used by do_allocate.
+    std::array<ActiveArena, numLanes> _active;
+    SizeType _reservedArenas = 0; // Number of free arenas which only reservations may tap.
+    SizeType _highPriorityArenas = 0; // Number of free arenas kept for high priority allocations.
+    SizeType _emergencyArenas = 0;    // Number of free arenas kept for emergency allocations.
+    std::array<SizeType, numPriorities> _reserveTaps {}; // Reserve arenas tapped by each priority.
+    std::size_t _numArenaSwitches = 0; // Times an active arena has been replaced with a free one.
+    OutOfArenasHandler _outOfArenasHandler = nullptr;
+    void* _outOfArenasContext = nullptr;
+    SizeType _maxRetries = 0;   // How many times the handler may be called per allocation.
+    std::atomic<ArenaReleasedHandler> _arenaReleasedHandler {nullptr};
+    std::atomic<void*> _arenaReleasedContext {nullptr};
+
+    // An allocation of the given priority may tap a free arena only if there are
+    // more free arenas than this.
+    SizeType tapThreshold(Priority priority) const
+    {
+        SizeType threshold = _reservedArenas;
+        if (priority == Priority::Normal)
+            threshold += _highPriorityArenas + _emergencyArenas;
+        else if (priority == Priority::High)
+            threshold += _emergencyArenas;
+        return threshold;
+    }
+    std::shared_mutex _mtx;
+    std::condition_variable_any _arenaReleased; // Signalled when space is freed if there are waiters.
+    SizeType _numWaiters = 0;   // Number of threads waiting in allocateWait.
+    WaitStatistics _waitStatistics;
+#if MULTIARENA_PROFILE
+    ContentionProfiler _profiler;
+#endif
+
+    // Lock helpers for the allocation, arena switch, recycle and lease paths.
+    // The waits are profiled if MULTIARENA_PROFILE is set.
+    std::shared_lock<std::shared_mutex> lockForAllocation()
+    {
+#if MULTIARENA_PROFILE
+        return lockProfiled<std::shared_lock<std::shared_mutex>>(ContentionProfiler::SharedLock);
+#else
+        return std::shared_lock<std::shared_mutex>(_mtx);
+#endif
+    }
+
+    std::unique_lock<std::shared_mutex> lockForSwitch()
+    {
+#if MULTIARENA_PROFILE
+        return lockProfiled<std::unique_lock<std::shared_mutex>>(ContentionProfiler::SwitchLock);
+#else
+        return std::unique_lock<std::shared_mutex>(_mtx);
+#endif
+    }
+
+    std::shared_lock<std::shared_mutex> lockForRecycle()
+    {
+#if MULTIARENA_PROFILE
+        return lockProfiled<std::shared_lock<std::shared_mutex>>(ContentionProfiler::RecycleLock);
+#else
+        return std::shared_lock<std::shared_mutex>(_mtx);
+#endif
+    }
+
+    std::unique_lock<std::shared_mutex> lockForLease()
+    {
+#if MULTIARENA_PROFILE
+        return lockProfiled<std::unique_lock<std::shared_mutex>>(ContentionProfiler::LeaseLock);
+#else
+        return std::unique_lock<std::shared_mutex>(_mtx);
+#endif
+    }
+
+#if MULTIARENA_PROFILE
+    template <class Lock>
+    Lock lockProfiled(ContentionProfiler::Event event)
+    {
+        auto start = std::chrono::steady_clock::now();
+        Lock lock(_mtx);
+        _profiler.recordLock(event, std::chrono::steady_clock::now() - start);
+        return lock;
+    }
+#endif
+
+    // Counts an allocation which did not fit in the active arena.
+    void profileFailedFit()
+    {
+#if MULTIARENA_PROFILE
+        _profiler.recordFailedFit();
+#endif
+    }
+
+    // Wakes up the threads waiting in allocateWait, if any.
+    // Note: the mutex must be locked before this function is called.
+    void notifyWaiters()
+    {
+        if (_numWaiters > 0)
+            _arenaReleased.notify_all();
+    }
+
+    // Calls the arena released handler, if any.
+    // Note: the mutex must not be locked when this function is called.
+    void notifyArenaReleased()
+    {
+        if (ArenaReleasedHandler handler = _arenaReleasedHandler.load(std::memory_order_acquire))
+            handler(_arenaReleasedContext.load(std::memory_order_relaxed));
+    }
+
+    // Pointer to the beginning of the data buffer of the given arena
+    uintptr_t arenaBegin(SizeType arenaId) const
+    {
+        return reinterpret_cast<uintptr_t>(derived()->_arenaData.data()) + arenaId * derived()->arenaSize();
+    }
+
+    // Number of bytes reserved in the given active arena
+    SizeType bytesReserved(const ActiveArena& lane) const
+    {
+        return SizeType(lane.data.load(std::memory_order_relaxed) - arenaBegin(lane.arenaId));
+    }
+
+    // Returns true and updates the given active arena if a free arena is available.
+    // Otherwise, returns false and doesn't change anything.
+    // Note: the mutex must be locked before this function is called.
+    bool reserveNextArena(ActiveArena& lane, Priority priority = Priority::Normal)
+    {
+        if (_freeListHead <= tapThreshold(priority))
+            return false;
+        if (_freeListHead <= tapThreshold(Priority::Normal))
+            ++_reserveTaps[std::size_t(priority)];
+        if (lane.arenaId != noArena)
+            ++_numArenaSwitches;
+        lane.arenaId = popFreeArena();
+        // data points to the first byte of the arena.
+        lane.data = arenaBegin(lane.arenaId);
+        lane.end = arenaBegin(lane.arenaId + 1);
+        return true;
+    }
+
+    // Re-initialize an active arena in an optimized way without
+    // release/reserve cycle.
+    // Note: mutex must be locked exclusively before this function is called.
+    void resetActiveArena(ActiveArena& lane)
+    {
+        MULTIARENA_ASSERT(allocationsInArena(lane.arenaId) == 0);
+        lane.data = arenaBegin(lane.arenaId);
+        derived()->_numAllocationsInArena[lane.arenaId].reset();
+        notifyWaiters();
+    }
+
+    // Returns the lifetime class whose active arena is the given one or nullptr if none.
+    // Note: mutex must be locked before this function is called.
+    ActiveArena* activeArenaOf(SizeType arenaId)
+    {
+        for (ActiveArena& lane : _active)
+            if (lane.arenaId == arenaId)
+                return &lane;
+        return nullptr;
+    }
+
+    // The allocation counter of a leased arena is biased by this much so that
+    // deallocations made by other threads can never make the arena look vacant.
+    static constexpr SizeType leaseBias = SizeType(1) << 31;
+
+    // Number of arenas needed for count allocations of the given size
+    // or noArena if the allocations don't fit in the resource.
+    SizeType arenasNeeded(std::size_t bytes, std::size_t count) const
+    {
+        constexpr std::size_t binSize = alignof(std::max_align_t);
+        std::size_t numBytesNeeded = (bytes + binSize - 1) / binSize * binSize;
+        if (numBytesNeeded > derived()->arenaSize())
+            return noArena;
+        if (numBytesNeeded == 0 || count == 0)
+            return 0;
+        std::size_t allocationsPerArena = derived()->arenaSize() / numBytesNeeded;
+        std::size_t numArenas = (count + allocationsPerArena - 1) / allocationsPerArena;
+        return (numArenas <= derived()->numArenas()) ? SizeType(numArenas) : noArena;
+    }
+
+    // Takes a free arena out of the free list for a lease.
+    // If bReserved is true, the arena is one of the reserved arenas.
+    // Returns noArena if there are no free arenas.
+    SizeType beginLease(bool bReserved = false)
+    {
+        const auto lock = lockForLease();
+        if (bReserved) {
+            MULTIARENA_ASSERT(_reservedArenas > 0);
+            --_reservedArenas;
+        }
+        else if (_freeListHead <= tapThreshold(Priority::Normal)) {
+            return noArena;
+        }
+        SizeType arenaId = popFreeArena();
+        derived()->_numAllocationsInArena[arenaId].counts.store(AllocationCounter::pack(leaseBias, 0), std::memory_order_relaxed);
+        return arenaId;
+    }
+
+    // Publishes a batch of allocations made through a lease of the given arena.
+    // The allocations are not counted one by one because the bias already keeps
+    // the arena from looking vacant.
+    void publishLease(SizeType arenaId, SizeType numAllocations)
+    {
+        derived()->_numAllocationsInArena[arenaId].counts.fetch_add(
+            numAllocations * AllocationCounter::oneAllocation, std::memory_order_relaxed);
+    }
+
+    // Ends the lease of the given arena and publishes the allocations not published yet.
+    // The arena goes back to the free list if everything allocated through the lease
+    // has been freed already. Otherwise it becomes a normal busy arena which will be
+    // released by the last deallocation.
+    void endLease(SizeType arenaId, SizeType numUnpublished)
+    {
+        uint64_t next;
+        {
+            const auto lock = lockForLease();
+            std::atomic<uint64_t>& counts = derived()->_numAllocationsInArena[arenaId].counts;
+            uint64_t prev = counts.load(std::memory_order_relaxed);
+            do { // A vacant arena is claimed for release in the same step by zeroing the counts.
+                SizeType numAllocations = AllocationCounter::allocations(prev) - leaseBias + numUnpublished;
+                next = (AllocationCounter::deallocations(prev) == numAllocations) ? 0 :
+                       AllocationCounter::pack(numAllocations, AllocationCounter::deallocations(prev));
+            } while (!counts.compare_exchange_weak(prev, next, std::memory_order_acq_rel, std::memory_order_relaxed));
+            if (next == 0)
+                releaseArena(arenaId);
+        }
+        if (next == 0)
+            notifyArenaReleased();
+    }
+
+    // Carves a slice of sliceSize bytes from the default active arena for a thread allocation buffer.
+    // The arena is charged with numBlocks allocations at once. Returns nullptr if there are no free arenas.
+    void* claimSlice(SizeType sliceSize, SizeType numBlocks)
+    {
+        ActiveArena& lane = _active[0];
+        uint64_t charge = numBlocks * AllocationCounter::oneAllocation;
+        void* result = allocateFromActiveArena(lane, sliceSize, charge);
+        if (result == nullptr) {
+            profileFailedFit();
+            const auto lock = lockForSwitch();
+            result = do_allocate_details(sliceSize, lane, Priority::Normal, charge);
+        }
+        return result;
+    }
+
+    // Takes back the charge of the blocks which were not allocated from a slice.
+    // Releases the arena if it became vacant.
+    void returnSlice(SizeType arenaId, SizeType numUnusedBlocks)
+    {
+        uint64_t charge = numUnusedBlocks * AllocationCounter::oneAllocation;
+        uint64_t prev = derived()->_numAllocationsInArena[arenaId].counts.fetch_sub(charge, std::memory_order_acq_rel);
+        // The charge is gone if the resource was released while the slice was claimed.
+        MULTIARENA_ASSERT(AllocationCounter::allocations(prev) - AllocationCounter::deallocations(prev) >= numUnusedBlocks);
+        uint64_t counts = prev - charge;
+        if (releaseIfVacant(arenaId, counts))
+            notifyArenaReleased();
+    }
+
+    // Returns the reserved arenas which were not tapped.
+    void endReservation(SizeType numArenas)
+    {
+        {
+            const auto lock = lockForLease();
+            MULTIARENA_ASSERT(_reservedArenas >= numArenas);
+            _reservedArenas -= numArenas;
+            notifyWaiters();
+        }
+        notifyArenaReleased();
+    }
+
+    // Recycle the given vacant arena by moving it to the freelist.
+    // Note: mutex must be locked, at least shared, before this function is called.
+    void releaseArena(SizeType arenaId)
+    {
+        MULTIARENA_ASSERT(allocationsInArena(arenaId) == 0);
+        MULTIARENA_ASSERT(activeArenaOf(arenaId) == nullptr);
+        derived()->_numAllocationsInArena[arenaId].reset();
+        pushFreeArena(arenaId);
+        notifyWaiters();
+    }
+
+private:
+    auto derived() const
+    {
+        return static_cast<const Derived*>(this);
+    }
+
+    auto derived()
+    {
+        return static_cast<Derived*>(this);
+    }
+
+    // Tap a new arena if there is not enough space left in the given active arena.
+    // Returns nullptr if all arenas are out of memory and the allocation can't hence be made.
+    // Assume that alignment is a power of 2.
+    // Also assume that the mutex locked on entry.
+    // The counts of the arena are incremented by charge.
+    void* do_allocate_details(std::size_t bytes, ActiveArena& lane, Priority priority,
+                              uint64_t charge = AllocationCounter::oneAllocation) noexcept
+    {
+        // Is there still space in the currently active arena?
+        if (lane.arenaId == noArena || bytesReserved(lane) + bytes > derived()->arenaSize()) {
+            // If everything in the active arena has been freed, reuse it.
+            uint64_t counts = lane.arenaId == noArena ? 1 :
+                derived()->_numAllocationsInArena[lane.arenaId].counts.load(std::memory_order_acquire);
+            if (AllocationCounter::allocations(counts) == AllocationCounter::deallocations(counts)) {
+                resetActiveArena(lane);
+                return do_allocate_details(bytes, lane, priority, charge);
+            }
+            // Otherwise retire it and tap a new arena. The last deallocation will release it.
+            if (reserveNextArena(lane, priority))
+                return do_allocate_details(bytes, lane, priority, charge);
+            return nullptr; // We are out of arenas
+        }
+        // Update the number of allocations made in the current arena.
+        derived()->_numAllocationsInArena[lane.arenaId].counts.fetch_add(charge, std::memory_order_relaxed);
+        return  reinterpret_cast<void*>(lane.data.fetch_add(bytes, std::memory_order_relaxed));
+    }
+
+    // Allocates the given number of bytes from the active arena under the shared lock
+    // and increments the counts of the arena by charge.
+    // Returns nullptr if the block does not fit in the active arena.
+    void* allocateFromActiveArena(ActiveArena& lane, uintptr_t numBytesNeeded,
+                                  uint64_t charge = AllocationCounter::oneAllocation)
+    {
+        void* result = nullptr;
+        const auto lock = lockForAllocation();
+        // Bump the data pointer if the block fits in the active arena, up to the last byte.
+        // Note that the active arena can not change because of the shared lock.
+        if (uintptr_t prevData = boundedBump(lane.data, lane.end, numBytesNeeded)) {
+            derived()->_numAllocationsInArena[lane.arenaId].counts.fetch_add(charge, std::memory_order_relaxed);
+            result = reinterpret_cast<void*>(prevData);
+        }
+        return result;
+    }
+
+    // Returns pointer to a block of data whose size it at least bytes
+    // and which is aligned to alignof(max_align_t).
+    void* allocateFromLane(ActiveArena& lane, std::size_t bytes, Priority priority = Priority::Normal)
+    {
+        if (bytes == 0)
+            return nullptr;
+        // Assume that _bytesReserved is divisible by alignof(max_align_t) (== usually 16)
+        // and the arena is split into bins of size binSize.
+        constexpr std::size_t binSize = alignof(max_align_t);
+
+        // How many bins are needed for data?
+        std::size_t numBinsForData = (bytes + binSize - 1) / binSize;
+        // Calculate how many bytes will be reserved from the active arena, including alignment to binSize.
+        uintptr_t numBytesNeeded = numBinsForData * binSize;
+        if (numBytesNeeded > derived()->arenaSize()) // Too large request
+            return nullptr;
+
+        void* result = allocateFromActiveArena(lane, numBytesNeeded);
+        if (result == nullptr) { // The allocation does not fit in the active arena, so change the arena.
+            profileFailedFit();
+            auto lock = lockForSwitch();
+            result = do_allocate_details(numBytesNeeded, lane, priority);
+            OutOfArenasHandler handler = _outOfArenasHandler;
+            void* context = _outOfArenasContext;
+            SizeType maxRetries = _maxRetries;
+            lock.unlock();
+
+            // Out of free arenas? Let the handler make room and retry.
+            for (SizeType retry = 0; result == nullptr && retry < maxRetries && handler && handler(bytes, context); ++retry) {
+                lock.lock();
+                result = do_allocate_details(numBytesNeeded, lane, priority);
+                lock.unlock();
+            }
+
+            if constexpr (exceptionsEnabled) {
+                if (result == nullptr) { // Find out the reason for failure.
+                    if (numBytesNeeded > derived()->arenaSize()) // Too large block requested
+                        throw AllocateTooLargeBlock(bytes, derived()->arenaSize());
+                    else
+                        throw OutOfFreeArenas(derived()->numArenas());
+                }
+            }
+        }
+        return result;
+    }
+
+protected:
+    // Returns pointer to a block of data whose size it at least bytes
+    // and which is aligned to alignof(max_align_t).
+    // So the alignment argument is ignored.
+    void* do_allocate(std::size_t bytes, std::size_t) override
+    {
+        return allocateFromLane(_active[0], bytes);
+    }
+
+    // Virtual allocate function.
+    // Note that bytes and alignment are used only when an exception is thrown
+    // so they are actually only debug helpers and may be left out.
+    void do_deallocate(void* p,
+                       std::size_t bytes = 0,
+                       std::size_t alignment = alignof(std::max_align_t)) override
+    {
+        if (p == nullptr)
+            return;
+        // Calculate the id of the arena where the address has come from.
+        uintptr_t ptrAsInteger = reinterpret_cast<uintptr_t>(p);
+        uintptr_t dataAsInteger = reinterpret_cast<uintptr_t>(derived()->_arenaData.data());
+        SizeType arenaId = SizeType(ptrAsInteger - dataAsInteger) / derived()->arenaSize();
+        if constexpr (exceptionsEnabled) {
+            if (arenaId >= derived()->numArenas()) // There is either double-free or memory corruption
+                throw ArenaMemoryResourceCorruption(p, bytes, alignment);
+        }
+        // Did the arena become vacant? The counts are updated in one atomic step so
+        // exactly one deallocation sees it. The release ordering makes the writes to
+        // the freed block visible to the thread which recycles the arena.
+        uint64_t counts = derived()->_numAllocationsInArena[arenaId].counts.fetch_add(
+            AllocationCounter::oneDeallocation, std::memory_order_acq_rel) + AllocationCounter::oneDeallocation;
+        if (releaseIfVacant(arenaId, counts))
+            notifyArenaReleased();
+    }
+
+    // Releases the arena if the given counts, which were just stored, tell that it became vacant.
+    // Returns true if the arena was released or if it is an active arena which became vacant.
+    bool releaseIfVacant(SizeType arenaId, uint64_t counts)
+    {
+        MULTIARENA_ASSERT(AllocationCounter::allocations(counts) >= AllocationCounter::deallocations(counts));
+        if (AllocationCounter::allocations(counts) != AllocationCounter::deallocations(counts))
+            return false;
+        // The shared lock keeps the active arenas and the free list policy from changing.
+        // An active arena which became vacant is reused when it no longer has space,
+        // so the threads waiting in allocateWait are woken up to reuse it.
+        // A retired arena is claimed by zeroing the counts and pushed to the lock-free free list.
+        {
+            const auto lock = lockForRecycle();
+            ActiveArena* lane = activeArenaOf(arenaId);
+            if (lane == nullptr) {
+                if (!derived()->_numAllocationsInArena[arenaId].counts.compare_exchange_strong(
+                        counts, 0, std::memory_order_acq_rel, std::memory_order_relaxed))
+                    return false;
+                releaseArena(arenaId); // Release the arena back to the free list.
+                return true;
+            }
+            if (lane != &_active[reserveLane]) {
+                notifyWaiters();
+                return true;
+            }
+        } // Release the lock
+        // A reserve arena is given back as soon as it is vacant. Retiring the lane needs the exclusive lock.
+        const auto lock = lockForSwitch();
+        ActiveArena& lane = _active[reserveLane];
+        if (lane.arenaId != arenaId ||
+            !derived()->_numAllocationsInArena[arenaId].counts.compare_exchange_strong(
+                counts, 0, std::memory_order_acq_rel, std::memory_order_relaxed))
+            return false;
+        lane.data = 0;
+        lane.end = 0;
+        lane.arenaId = noArena;
+        releaseArena(arenaId);
+        return true;
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return (this == &other);
+    }
+
+    // Number of currently active allocation in the given arena.
+    SizeType allocationsInArena(SizeType arenaId) const
+    {
+        uint64_t counts = derived()->_numAllocationsInArena[arenaId].counts.load(std::memory_order_relaxed);
+        SizeType allocations = AllocationCounter::allocations(counts);
+        if (allocations >= leaseBias) { // The arena is leased and counted in batches.
+            allocations -= leaseBias;
+            return (allocations > AllocationCounter::deallocations(counts)) ?
+                   allocations - AllocationCounter::deallocations(counts) : 0;
+        }
+        MULTIARENA_ASSERT(allocations >= AllocationCounter::deallocations(counts));
+        return allocations - AllocationCounter::deallocations(counts);
+    }
+}; // SynchronizedArenaResourceBase
+
+
+// Synchronized (i.e. thread-safe) memory resource where the data
+// is allocated from the  stack.
+template <SizeType NUM_ARENAS, SizeType ARENA_SIZE>
+class SynchronizedArenaResource :
+    public SynchronizedArenaResourceBase<SynchronizedArenaResource<NUM_ARENAS, ARENA_SIZE>>
+{
+public:
+    using Base = SynchronizedArenaResourceBase<SynchronizedArenaResource<NUM_ARENAS, ARENA_SIZE>>;
+    explicit SynchronizedArenaResource(SizeType = 0, SizeType = 0)
+        noexcept(!exceptionsEnabled) : Base(NUM_ARENAS, ARENA_SIZE)
+    {
+        static_assert(NUM_ARENAS > 0, "There must be at least one arena.");
+        static_assert(ARENA_SIZE % alignof(std::max_align_t) == 0," Arena size must be divisible by max alignment.");
+        this->initializeArenas();
+    }
+
+    constexpr SizeType numArenas() const { return NUM_ARENAS; }
+    constexpr SizeType arenaSize() const { return ARENA_SIZE; }
+
+    friend class SynchronizedArenaResourceBase<SynchronizedArenaResource<NUM_ARENAS, ARENA_SIZE>>;
+    friend typename Base::FreeList;
+protected:
+
+    // Number of allocations and deallocations done in each arena since the arena was activated.
+    alignas(hardware_constructive_interference_size) std::array<AllocationCounter, NUM_ARENAS> _numAllocationsInArena;
+    // List of free arenas.
+    std::array<SizeType, NUM_ARENAS> _freeList;
+    // Bitmap of free arenas.
+    std::array<std::atomic<uint64_t>, (NUM_ARENAS + bitsPerWord - 1) / bitsPerWord> _freeBitmap;
+    alignas(hardware_constructive_interference_size) // Align to a cache line.
+        std::array<std::byte, NUM_ARENAS * ARENA_SIZE> _arenaData;
+};  // SynchronizedArenaResource in stack
+
+
+// Synchronized (i.e. thread-safe) memory resource where the data
+// is allocated from the given memory resource (system heap by default.)
+template <>
+class SynchronizedArenaResource<0, 0> :
+    public SynchronizedArenaResourceBase<SynchronizedArenaResource<0, 0>>
+{
+public:
+    using Base = SynchronizedArenaResourceBase<SynchronizedArenaResource<0, 0>>;
+    explicit SynchronizedArenaResource(SizeType numArenas, SizeType arenaSize, std::pmr::memory_resource* mr = nullptr)
+        : Base(numArenas, arenaSize), _numArenas(numArenas), _arenaSize(arenaSize)
+    {
+        assert(numArenas > 0);
+        assert(arenaSize % alignof(std::max_align_t) == 0);
+        if (!mr)
+            mr = std::pmr::new_delete_resource();
+
+        // Allocate arenas using the given memory resource.
+        constructPmrContainerAt(&_numAllocationsInArena, mr, numArenas);
+        constructPmrContainerAt(&_freeList, mr, numArenas);
+        constructPmrContainerAt(&_freeBitmap, mr, (numArenas + bitsPerWord - 1) / bitsPerWord);
+        constructPmrContainerAt(&_arenaData, mr, numArenas * arenaSize, std::byte{});
+
+        this->initializeArenas();
+    }
+
+    SizeType numArenas() const { return _numArenas; }
+    SizeType arenaSize() const { return _arenaSize; }
+
+    friend class SynchronizedArenaResourceBase<SynchronizedArenaResource<0, 0>>;
+    friend Base::FreeList;
+
+protected:
+    // Number of allocations and deallocation done in each arena since the arena was activated.
+    std::pmr::vector<AllocationCounter> _numAllocationsInArena;
+    // List of free arenas.
+    std::pmr::vector<SizeType> _freeList;
+    // Bitmap of free arenas.
+    std::pmr::vector<std::atomic<uint64_t>> _freeBitmap;
+    std::pmr::vector<std::byte> _arenaData;
+    SizeType _numArenas;  // Number of arenas.
+    SizeType _arenaSize;  // Size of each arena in bytes.
+};  // SynchronizedArenaResource in stack
+
+// Base class for the variants of the single producer memory resource.
+// One thread (the producer) allocates and any number of threads free.
+// An allocation is a plain bump of the data pointer without atomics or locks.
+// A deallocation is a single atomic decrement of the number of allocations
+// outstanding in the arena. The thread which frees the last allocation of
+// a retired arena returns the arena to the producer through a lock-free list.
+template <class Derived>
+class SingleProducerArenaResourceBase : public std::pmr::memory_resource
+{
+public:
+    // Returns true if the given address lies within the arenas of this resource.
+    bool contains(const void* p) const
+    {
+        uintptr_t ptrAsInteger = reinterpret_cast<uintptr_t>(p);
+        return ptrAsInteger >= arenaBegin(0) &&
+               ptrAsInteger - arenaBegin(0) < std::size_t(derived()->numArenas()) * derived()->arenaSize();
+    }
+
+    // Number of non-empty arenas. Must be called by the producer.
+    SizeType numberOfBusyArenas()
+    {
+        collectReturnedArenas();
+        SizeType result = derived()->numArenas() - _freeListHead;
+        // The active arena is not busy if everything allocated from it has been freed.
+        if (_activeArena != noArena &&
+            derived()->_arenaState[_activeArena].outstanding.load(std::memory_order_relaxed) == activeBias - _numAllocations)
+            --result;
+        return result;
+    }
+
+protected:
+    void initializeArenas()
+    {
+        for (SizeType i = 0; i < derived()->numArenas(); ++i) {
+            derived()->_freeList[i] = derived()->numArenas() - 1 - i;
+            derived()->_arenaState[i].outstanding.store(0, std::memory_order_relaxed);
+        }
+        _freeListHead = derived()->numArenas();
+        _returnedArenas.store(noArena, std::memory_order_relaxed);
+        _activeArena = noArena;
+        _data = _end = 0;
+        _numAllocations = 0;
+    }
+
+    static constexpr SizeType noArena = ~SizeType(0);
+
+    // The number of outstanding allocations of the active arena is biased by
+    // this much so that the deallocations can never make it look vacant.
+    static constexpr SizeType activeBias = SizeType(1) << (8 * sizeof(SizeType) - 1);
+
+    // Per arena state shared by the producer and the consumers.
+    struct alignas(hardware_constructive_interference_size) ArenaState
+    {
+        std::atomic<SizeType> outstanding; // Allocations not yet freed (plus activeBias if active).
+        SizeType nextReturned;             // Next arena in the list of returned arenas.
+    };
+
+    uintptr_t arenaBegin(SizeType arenaId) const
+    {
+        return reinterpret_cast<uintptr_t>(derived()->_arenaData.data()) + arenaId * derived()->arenaSize();
+    }
+
+    void* do_allocate(std::size_t bytes, std::size_t) override
+    {
+        if (bytes == 0)
+            return nullptr;
+        constexpr std::size_t binSize = alignof(std::max_align_t);
+        uintptr_t numBytesNeeded = (bytes + binSize - 1) / binSize * binSize;
+        if (_end - _data < numBytesNeeded) { // Does not fit in the active arena.
+            if (numBytesNeeded > derived()->arenaSize() || !tapNextArena()) {
+                if constexpr (exceptionsEnabled) {
+                    if (numBytesNeeded > derived()->arenaSize())
+                        throw AllocateTooLargeBlock(bytes, derived()->arenaSize());
+                    throw OutOfFreeArenas(derived()->numArenas());
+                }
+                return nullptr;
+            }
+        }
+        void* result = reinterpret_cast<void*>(_data);
+        _data += numBytesNeeded;
+        ++_numAllocations;
+        return result;
+    }
+
+    void do_deallocate(void* p,
+                       std::size_t bytes = 0,
+                       std::size_t alignment = alignof(std::max_align_t)) override
+    {
+        if (p == nullptr)
+            return;
+        SizeType arenaId = SizeType((reinterpret_cast<uintptr_t>(p) - arenaBegin(0)) / derived()->arenaSize());
+        if constexpr (exceptionsEnabled) {
+            if (arenaId >= derived()->numArenas()) // There is either double-free or memory corruption
+                throw ArenaMemoryResourceCorruption(p, bytes, alignment);
+        }
+        if (derived()->_arenaState[arenaId].outstanding.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            returnArena(arenaId); // The last allocation of a retired arena was freed.
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return (this == &other);
+    }
+
+private:
+    auto derived() const
+    {
+        return static_cast<const Derived*>(this);
+    }
+
+    auto derived()
+    {
+        return static_cast<Derived*>(this);
+    }
+
+    // Pushes a vacant arena to the list of returned arenas. Called by any thread.
+    void returnArena(SizeType arenaId)
+    {
+        SizeType head = _returnedArenas.load(std::memory_order_relaxed);
+        do {
+            derived()->_arenaState[arenaId].nextReturned = head;
+        } while (!_returnedArenas.compare_exchange_weak(head, arenaId, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    // Moves the returned arenas to the free list of the producer.
+    void collectReturnedArenas()
+    {
+        if (_returnedArenas.load(std::memory_order_relaxed) == noArena)
+            return;
+        SizeType arenaId = _returnedArenas.exchange(noArena, std::memory_order_acquire);
+        while (arenaId != noArena) {
+            derived()->_freeList[_freeListHead++] = arenaId;
+            arenaId = derived()->_arenaState[arenaId].nextReturned;
+        }
+    }
+
+    // Retires the active arena and activates a free one.
+    // Returns false if there are no free arenas.
+    bool tapNextArena()
+    {
+        if (_activeArena != noArena) {
+            // Replace the bias with the number of allocations actually made.
+            // If everything has been freed already, the arena can be reused right away.
+            std::atomic<SizeType>& outstanding = derived()->_arenaState[_activeArena].outstanding;
+            if (outstanding.fetch_sub(activeBias - _numAllocations, std::memory_order_acq_rel) == activeBias - _numAllocations)
+                derived()->_freeList[_freeListHead++] = _activeArena;
+            _activeArena = noArena;
+            _data = _end = 0;
+        }
+        if (_freeListHead == 0)
+            collectReturnedArenas();
+        if (_freeListHead == 0)
+            return false;
+        _activeArena = derived()->_freeList[--_freeListHead];
+        derived()->_arenaState[_activeArena].outstanding.store(activeBias, std::memory_order_relaxed);
+        _data = arenaBegin(_activeArena);
+        _end = _data + derived()->arenaSize();
+        _numAllocations = 0;
+        return true;
+    }
+
+    // The state of the producer.
+    uintptr_t _data;              // Next free address in the active arena.
+    uintptr_t _end;               // One past the last byte of the active arena.
+    SizeType _activeArena;        // Id of the active arena or noArena.
+    SizeType _numAllocations;     // Number of allocations made in the active arena.
+    SizeType _freeListHead;       // Number of arenas in the free list of the producer.
+    // Head of the list of arenas which were vacated by the consumers.
+    alignas(hardware_constructive_interference_size) std::atomic<SizeType> _returnedArenas;
+}; // SingleProducerArenaResourceBase
+
+// Single producer memory resource where the data is allocated from the stack.
+// Only one thread may allocate but any thread may deallocate.
+template <SizeType NUM_ARENAS = 0, SizeType ARENA_SIZE = 0>
+class SingleProducerArenaResource :
+    public SingleProducerArenaResourceBase<SingleProducerArenaResource<NUM_ARENAS, ARENA_SIZE>>
+{
+public:
+    using Base = SingleProducerArenaResourceBase<SingleProducerArenaResource<NUM_ARENAS, ARENA_SIZE>>;
+    explicit SingleProducerArenaResource(SizeType = 0, SizeType = 0, std::pmr::memory_resource* = nullptr)
+    {
+        static_assert(NUM_ARENAS > 0, "There must be at least one arena.");
+        static_assert(ARENA_SIZE % alignof(std::max_align_t) == 0," Arena size must be divisible by max alignment.");
+        this->initializeArenas();
+    }
+
+    constexpr SizeType numArenas() const { return NUM_ARENAS; }
+    constexpr SizeType arenaSize() const { return ARENA_SIZE; }
+
+    friend class SingleProducerArenaResourceBase<SingleProducerArenaResource<NUM_ARENAS, ARENA_SIZE>>;
+protected:
+    std::array<typename Base::ArenaState, NUM_ARENAS> _arenaState;
+    // List of free arenas owned by the producer.
+    std::array<SizeType, NUM_ARENAS> _freeList;
+    alignas(hardware_constructive_interference_size) // Align to a cache line.
+        std::array<std::byte, ARENA_SIZE * NUM_ARENAS> _arenaData;
+};  // SingleProducerArenaResource in stack
+
+// Single producer memory resource where the data is allocated from
+// the given memory resource (system heap by default.)
+template <>
+class SingleProducerArenaResource<0, 0> :
+    public SingleProducerArenaResourceBase<SingleProducerArenaResource<0, 0>>
+{
+public:
+    using Base = SingleProducerArenaResourceBase<SingleProducerArenaResource<0, 0>>;
+    explicit SingleProducerArenaResource(SizeType numArenas, SizeType arenaSize, std::pmr::memory_resource* mr = nullptr)
+        : _numArenas(numArenas), _arenaSize(arenaSize)
+    {
+        assert(numArenas > 0);
+        assert(arenaSize % alignof(std::max_align_t) == 0);
+        if (!mr)
+            mr = std::pmr::new_delete_resource();
+
+        // Allocate arenas using the given memory resource.
+        constructPmrContainerAt(&_arenaState, mr, numArenas);
+        constructPmrContainerAt(&_freeList, mr, numArenas);
+        constructPmrContainerAt(&_arenaData, mr, numArenas * arenaSize, std::byte{});
+
+        this->initializeArenas();
+    }
+
+    SizeType numArenas() const { return _numArenas; }
+    SizeType arenaSize() const { return _arenaSize; }
+
+    friend class SingleProducerArenaResourceBase<SingleProducerArenaResource<0, 0>>;
+
+protected:
+    std::pmr::vector<Base::ArenaState> _arenaState;
+    // List of free arenas owned by the producer.
+    std::pmr::vector<SizeType> _freeList;
+    std::pmr::vector<std::byte> _arenaData;
+    SizeType _numArenas;  // Number of arenas.
+    SizeType _arenaSize;  // Size of each arena in bytes.
+};  // SingleProducerArenaResource in heap
+
+// Base class for the variants of the async-signal-safe memory resource.
+// Allocation and deallocation use only lock-free atomic operations. They never lock,
+// never allocate and never throw, so they can be called from signal handlers and
+// interrupt a thread which is in the middle of an allocation of its own.
+// The active arena, the number of bytes used in it and the number of allocations made
+// in it are packed into one 64-bit word so that an allocation is a single CAS.
+// The free arenas are in a lock-free stack whose top carries a tag against ABA.
+// Allocations which can't be made return nullptr instead of throwing.
+// There can be at most 65535 arenas of at most 256 MiB each.
+template <class Derived>
+class SignalSafeArenaResourceBase : public std::pmr::memory_resource
+{
+public:
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "64-bit atomics must be lock-free.");
+
+    // Allocates a block aligned to alignof(max_align_t). Returns nullptr if bytes is zero,
+    // the block does not fit in an arena or there are no free arenas. Unlike allocate(),
+    // whose result must not be nullptr, this is the function to call in a signal handler.
+    void* tryAllocate(std::size_t bytes) noexcept
+    {
+        if (bytes == 0 || bytes > derived()->arenaSize())
+            return nullptr;
+        SizeType numBins = SizeType((bytes + binSize - 1) / binSize);
+        SizeType arenaBins = SizeType(derived()->arenaSize() / binSize);
+        uint64_t state = _state.load(std::memory_order_acquire);
+        for (;;) {
+            SizeType arenaId = stateArena(state);
+            if (arenaId != noArena && stateBins(state) + numBins <= arenaBins) { // Bump within the active arena.
+                if (_state.compare_exchange_weak(state, packState(arenaId, stateBins(state) + numBins, stateCount(state) + 1),
+                                                 std::memory_order_acq_rel, std::memory_order_acquire))
+                    return reinterpret_cast<void*>(arenaBegin(arenaId) + stateBins(state) * binSize);
+                continue;
+            }
+            // Tap a free arena and make it active unless another thread or signal handler gets there first.
+            SizeType nextArena = popFreeArena();
+            if (nextArena == noArena) {
+                uint64_t current = _state.load(std::memory_order_acquire);
+                if (current == state)
+                    return nullptr; // Out of arenas.
+                state = current;
+                continue;
+            }
+            derived()->_arenaCounts[nextArena].counts.store(AllocationCounter::pack(activeBias, 0), std::memory_order_relaxed);
+            if (_state.compare_exchange_strong(state, packState(nextArena, numBins, 1),
+                                               std::memory_order_acq_rel, std::memory_order_acquire)) {
+                if (arenaId != noArena)
+                    retireArena(arenaId, stateCount(state));
+                return reinterpret_cast<void*>(arenaBegin(nextArena));
+            }
+            derived()->_arenaCounts[nextArena].reset(); // Lost the race so put the arena back.
+            pushFreeArena(nextArena);
+        }
+    }
+
+    // Returns true if the given address lies within the arenas of this resource.
+    bool contains(const void* p) const
+    {
+        uintptr_t ptrAsInteger = reinterpret_cast<uintptr_t>(p);
+        return ptrAsInteger >= arenaBegin(0) &&
+               ptrAsInteger - arenaBegin(0) < std::size_t(derived()->numArenas()) * derived()->arenaSize();
+    }
+
+    // Number of allocations which have not been freed. Only a snapshot if other threads are active.
+    std::size_t numberOfAllocations() const
+    {
+        uint64_t state = _state.load(std::memory_order_acquire);
+        std::size_t result = 0;
+        for (SizeType i = 0; i < derived()->numArenas(); ++i) {
+            uint64_t counts = derived()->_arenaCounts[i].counts.load(std::memory_order_acquire);
+            SizeType allocations = (i == stateArena(state)) ? stateCount(state) : AllocationCounter::allocations(counts);
+            result += allocations - AllocationCounter::deallocations(counts);
+        }
+        return result;
+    }
+
+    // Number of non-empty arenas. Only a snapshot if other threads are active.
+    SizeType numberOfBusyArenas() const
+    {
+        uint64_t state = _state.load(std::memory_order_acquire);
+        SizeType result = derived()->numArenas() - _numFreeArenas.load(std::memory_order_acquire);
+        // The active arena is not busy if everything allocated from it has been freed.
+        if (stateArena(state) != noArena &&
+            AllocationCounter::deallocations(derived()->_arenaCounts[stateArena(state)].counts.load()) == stateCount(state))
+            --result;
+        return result;
+    }
+
+protected:
+    void initializeArenas()
+    {
+        MULTIARENA_ASSERT(derived()->numArenas() < maxArenas);
+        MULTIARENA_ASSERT(derived()->arenaSize() / binSize < (uint64_t(1) << 24));
+        // Arena 0 is on the top of the free stack.
+        for (SizeType i = 0; i < derived()->numArenas(); ++i) {
+            derived()->_freeLinks[i].store(i + 1 < derived()->numArenas() ? i + 1 : noArena, std::memory_order_relaxed);
+            derived()->_arenaCounts[i].reset();
+        }
+        _freeStackTop.store(0, std::memory_order_relaxed);
+        _numFreeArenas.store(derived()->numArenas(), std::memory_order_relaxed);
+        _state.store(packState(noArena, 0, 0), std::memory_order_release);
+    }
+
+    static constexpr SizeType noArena = 0xffff;
+    static constexpr SizeType maxArenas = noArena;
+    static constexpr std::size_t binSize = alignof(std::max_align_t);
+
+    // The allocation counter of the active arena is biased by this much so that
+    // the deallocations can never make it look vacant. The allocations made
+    // in the active arena are counted in _state instead.
+    static constexpr SizeType activeBias = SizeType(1) << 31;
+
+    // The state word: arena id in the top 16 bits, number of bins used in the next 24 bits
+    // and the number of allocations in the low 24 bits.
+    static constexpr uint64_t packState(SizeType arenaId, SizeType numBins, SizeType numAllocations)
+    {
+        return (uint64_t(arenaId) << 48) | (uint64_t(numBins) << 24) | numAllocations;
+    }
+    static constexpr SizeType stateArena(uint64_t state) { return SizeType(state >> 48); }
+    static constexpr SizeType stateBins(uint64_t state) { return SizeType(state >> 24) & 0xffffff; }
+    static constexpr SizeType stateCount(uint64_t state) { return SizeType(state) & 0xffffff; }
+
+    uintptr_t arenaBegin(SizeType arenaId) const
+    {
+        return reinterpret_cast<uintptr_t>(derived()->_arenaData.data()) + arenaId * derived()->arenaSize();
+    }
+
+    // Returns nullptr like tryAllocate instead of throwing.
+    void* do_allocate(std::size_t bytes, std::size_t) noexcept override
+    {
+        return tryAllocate(bytes);
+    }
+
+    void do_deallocate(void* p, std::size_t, std::size_t) noexcept override
+    {
+        if (p == nullptr)
+            return;
+        SizeType arenaId = SizeType((reinterpret_cast<uintptr_t>(p) - arenaBegin(0)) / derived()->arenaSize());
+        MULTIARENA_ASSERT(arenaId < derived()->numArenas()); // There is either double-free or memory corruption
+        if (arenaId >= derived()->numArenas())
+            return;
+        uint64_t counts = derived()->_arenaCounts[arenaId].counts.fetch_add(AllocationCounter::oneDeallocation, std::memory_order_acq_rel) +
+                          AllocationCounter::oneDeallocation;
+        releaseIfVacant(arenaId, counts);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return (this == &other);
+    }
+
+private:
+    auto derived() const
+    {
+        return static_cast<const Derived*>(this);
+    }
+
+    auto derived()
+    {
+        return static_cast<Derived*>(this);
+    }
+
+    // Replaces the bias of a retired arena with the number of allocations made in it.
+    void retireArena(SizeType arenaId, SizeType numAllocations)
+    {
+        uint64_t bias = AllocationCounter::pack(activeBias - numAllocations, 0);
+        uint64_t counts = derived()->_arenaCounts[arenaId].counts.fetch_sub(bias, std::memory_order_acq_rel) - bias;
+        releaseIfVacant(arenaId, counts);
+    }
+
+    // Exactly one update of the counts of a retired arena sees it become vacant.
+    void releaseIfVacant(SizeType arenaId, uint64_t counts)
+    {
+        if (AllocationCounter::allocations(counts) == AllocationCounter::deallocations(counts)) {
+            derived()->_arenaCounts[arenaId].reset();
+            pushFreeArena(arenaId);
+        }
+    }
+
+    // The top of the free stack: a tag in the high 32 bits and the arena id in the low 32 bits.
+    SizeType popFreeArena()
+    {
+        uint64_t top = _freeStackTop.load(std::memory_order_acquire);
+        SizeType arenaId;
+        do {
+            arenaId = SizeType(top);
+            if (arenaId == noArena)
+                return noArena;
+        } while (!_freeStackTop.compare_exchange_weak(top, ((top >> 32) + 1) << 32 | derived()->_freeLinks[arenaId].load(std::memory_order_relaxed),
+                                                      std::memory_order_acquire, std::memory_order_acquire));
+        _numFreeArenas.fetch_sub(1, std::memory_order_relaxed);
+        return arenaId;
+    }
+
+    void pushFreeArena(SizeType arenaId)
+    {
+        _numFreeArenas.fetch_add(1, std::memory_order_relaxed);
+        uint64_t top = _freeStackTop.load(std::memory_order_relaxed);
+        do {
+            derived()->_freeLinks[arenaId].store(SizeType(top), std::memory_order_relaxed);
+        } while (!_freeStackTop.compare_exchange_weak(top, ((top >> 32) + 1) << 32 | arenaId,
+                                                      std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    alignas(hardware_constructive_interference_size) std::atomic<uint64_t> _state; // See packState().
+    alignas(hardware_constructive_interference_size) std::atomic<uint64_t> _freeStackTop;
+    std::atomic<SizeType> _numFreeArenas;
+}; // SignalSafeArenaResourceBase
+
+// Async-signal-safe memory resource where the data is allocated from the stack.
+template <SizeType NUM_ARENAS = 0, SizeType ARENA_SIZE = 0>
+class SignalSafeArenaResource :
+    public SignalSafeArenaResourceBase<SignalSafeArenaResource<NUM_ARENAS, ARENA_SIZE>>
+{
+public:
+    using Base = SignalSafeArenaResourceBase<SignalSafeArenaResource<NUM_ARENAS, ARENA_SIZE>>;
+    explicit SignalSafeArenaResource(SizeType = 0, SizeType = 0, std::pmr::memory_resource* = nullptr)
+    {
+        static_assert(NUM_ARENAS > 0 && NUM_ARENAS < Base::maxArenas, "There must be 1...65534 arenas.");
+        static_assert(ARENA_SIZE % alignof(std::max_align_t) == 0," Arena size must be divisible by max alignment.");
+        static_assert(ARENA_SIZE / alignof(std::max_align_t) < (1u << 24), "Arena size must be less than 256 MiB.");
+        this->initializeArenas();
+    }
+
+    constexpr SizeType numArenas() const { return NUM_ARENAS; }
+    constexpr SizeType arenaSize() const { return ARENA_SIZE; }
+
+    friend class SignalSafeArenaResourceBase<SignalSafeArenaResource<NUM_ARENAS, ARENA_SIZE>>;
+protected:
+    std::array<AllocationCounter, NUM_ARENAS> _arenaCounts;
+    // Links of the free arena stack.
+    std::array<std::atomic<SizeType>, NUM_ARENAS> _freeLinks;
+    alignas(hardware_constructive_interference_size) // Align to a cache line.
+        std::array<std::byte, ARENA_SIZE * NUM_ARENAS> _arenaData;
+};  // SignalSafeArenaResource in stack
+
+// Async-signal-safe memory resource where the data is allocated from
+// the given memory resource (system heap by default) when the resource is constructed.
+template <>
+class SignalSafeArenaResource<0, 0> :
+    public SignalSafeArenaResourceBase<SignalSafeArenaResource<0, 0>>
+{
+public:
+    using Base = SignalSafeArenaResourceBase<SignalSafeArenaResource<0, 0>>;
+    explicit SignalSafeArenaResource(SizeType numArenas, SizeType arenaSize, std::pmr::memory_resource* mr = nullptr)
+        : _numArenas(numArenas), _arenaSize(arenaSize)
+    {
+        assert(numArenas > 0 && numArenas < maxArenas);
+        assert(arenaSize % alignof(std::max_align_t) == 0);
+        if (!mr)
+            mr = std::pmr::new_delete_resource();
+
+        // Allocate arenas using the given memory resource.
+        constructPmrContainerAt(&_arenaCounts, mr, numArenas);
+        constructPmrContainerAt(&_freeLinks, mr, numArenas);
+        constructPmrContainerAt(&_arenaData, mr, numArenas * arenaSize, std::byte{});
+
+        this->initializeArenas();
+    }
+
+    SizeType numArenas() const { return _numArenas; }
+    SizeType arenaSize() const { return _arenaSize; }
+
+    friend class SignalSafeArenaResourceBase<SignalSafeArenaResource<0, 0>>;
+
+protected:
+    std::pmr::vector<AllocationCounter> _arenaCounts;
+    // Links of the free arena stack.
+    std::pmr::vector<std::atomic<SizeType>> _freeLinks;
+    std::pmr::vector<std::byte> _arenaData;
+    SizeType _numArenas;  // Number of arenas.
+    SizeType _arenaSize;  // Size of each arena in bytes.
+};  // SignalSafeArenaResource in heap
+
+// Thread-safe memory resource whose arenas are split into shards, one per CPU by default.
+// Each shard works like a SynchronizedArenaResource with its own lock, active arena and
+// free list, and a thread allocates from the shard of the CPU which runs it. When a shard
+// runs out of free arenas, it steals half of the free arenas of the nearest shard which
+// has any. A deallocation goes to the shard which owns the arena the block came from.
+// The arenas are allocated from the given memory resource (system heap by default.)
+class ShardedArenaResource : public std::pmr::memory_resource
+{
+public:
+    // If numShards is 0, there is one shard per hardware thread.
+    ShardedArenaResource(SizeType numArenas, SizeType arenaSize, SizeType numShards = 0,
+                         std::pmr::memory_resource* mr = nullptr)
+        : _numArenas(numArenas), _arenaSize(arenaSize),
+          _numShards(numShards ? numShards : std::max(SizeType(std::thread::hardware_concurrency()), SizeType(1)))
+    {
+        assert(numArenas > 0);
+        assert(arenaSize % alignof(std::max_align_t) == 0);
+        if (!mr)
+            mr = std::pmr::new_delete_resource();
+        _numShards = std::min(_numShards, numArenas);
+
+        constructPmrContainerAt(&_numAllocationsInArena, mr, numArenas);
+        constructPmrContainerAt(&_ownerShard, mr, numArenas);
+        constructPmrContainerAt(&_shards, mr, _numShards);
+        constructPmrContainerAt(&_arenaData, mr, std::size_t(numArenas) * arenaSize, std::byte{});
+
+        // Deal the arenas out to the shards in contiguous ranges.
+        for (SizeType i = 0; i < _numShards; ++i) {
+            Shard& shard = _shards[i];
+            constructPmrContainerAt(&shard.freeList, mr, numArenas);
+            SizeType first = SizeType(std::size_t(numArenas) * i / _numShards);
+            SizeType last = SizeType(std::size_t(numArenas) * (i + 1) / _numShards);
+            for (SizeType arenaId = last; arenaId-- > first; ) {
+                shard.freeList[shard.freeListHead++] = arenaId;
+                _ownerShard[arenaId].store(i, std::memory_order_relaxed);
+            }
+            shard.data = 0;
+            shard.end = 0;
+            shard.arenaId = noArena;
+        }
+    }
+
+    SizeType numArenas() const { return _numArenas; }
+    SizeType arenaSize() const { return _arenaSize; }
+    SizeType numShards() const { return _numShards; }
+
+    // Number of arenas one shard has stolen from another.
+    std::size_t numberOfSteals() const { return _numSteals.load(std::memory_order_relaxed); }
+
+    // Returns true if the given address lies within the arenas of this resource.
+    bool contains(const void* p) const
+    {
+        uintptr_t ptrAsInteger = reinterpret_cast<uintptr_t>(p);
+        return ptrAsInteger >= arenaBegin(0) &&
+               ptrAsInteger - arenaBegin(0) < std::size_t(_numArenas) * _arenaSize;
+    }
+
+protected:
+    static constexpr SizeType noArena = ~SizeType(0);
+
+    // Lock, active arena and free arenas of one shard. Each one lives in its own cache line.
+    struct alignas(hardware_constructive_interference_size) Shard
+    {
+        std::shared_mutex mtx;
+        std::atomic<uintptr_t> data; // Pointer to the next free address within the active arena.
+        uintptr_t end;               // One past the last byte of the active arena.
+        SizeType arenaId;            // Id of the active arena or noArena.
+        SizeType freeListHead = 0;   // Number of free arenas.
+        std::pmr::vector<SizeType> freeList;
+    };
+
+    uintptr_t arenaBegin(SizeType arenaId) const
+    {
+        return reinterpret_cast<uintptr_t>(_arenaData.data()) + std::size_t(arenaId) * _arenaSize;
+    }
+
+    void* do_allocate(std::size_t bytes, std::size_t) override
+    {
+        if (bytes == 0)
+            return nullptr;
+        constexpr std::size_t binSize = alignof(max_align_t);
+        uintptr_t numBytesNeeded = (bytes + binSize - 1) / binSize * binSize;
+        if (numBytesNeeded > _arenaSize) { // Too large request
+            if constexpr (exceptionsEnabled)
+                throw AllocateTooLargeBlock(bytes, _arenaSize);
+            return nullptr;
+        }
+        SizeType shardId = currentCpu() % _numShards;
+        Shard& shard = _shards[shardId];
+        void* result = nullptr;
+        {
+            // Bump the data pointer. The active arena can not change because of the shared lock.
+            const std::shared_lock<std::shared_mutex> lock(shard.mtx);
+            if (uintptr_t prevData = boundedBump(shard.data, shard.end, numBytesNeeded)) {
+                _numAllocationsInArena[shard.arenaId].counts.fetch_add(AllocationCounter::oneAllocation, std::memory_order_relaxed);
+                result = reinterpret_cast<void*>(prevData);
+            }
+        }
+        if (result == nullptr)
+            result = allocateSlow(shardId, numBytesNeeded);
+        if constexpr (exceptionsEnabled) {
+            if (result == nullptr)
+                throw OutOfFreeArenas(_numArenas);
+        }
+        return result;
+    }
+
+    void do_deallocate(void* p,
+                       std::size_t bytes = 0,
+                       std::size_t alignment = alignof(std::max_align_t)) override
+    {
+        if (p == nullptr)
+            return;
+        SizeType arenaId = SizeType((reinterpret_cast<uintptr_t>(p) - arenaBegin(0)) / _arenaSize);
+        if constexpr (exceptionsEnabled) {
+            if (arenaId >= _numArenas) // There is either double-free or memory corruption
+                throw ArenaMemoryResourceCorruption(p, bytes, alignment);
+        }
+        AllocationCounter& counter = _numAllocationsInArena[arenaId];
+        uint64_t counts = counter.counts.fetch_add(AllocationCounter::oneDeallocation, std::memory_order_acq_rel) +
+                          AllocationCounter::oneDeallocation;
+        if (AllocationCounter::allocations(counts) == AllocationCounter::deallocations(counts)) {
+            // A busy arena can't change its owner so the owner can be read before locking.
+            Shard& shard = _shards[_ownerShard[arenaId].load(std::memory_order_relaxed)];
+            const std::lock_guard<std::shared_mutex> lock(shard.mtx);
+            // The arena is still vacant if nobody has allocated from it or reset it since.
+            if (counter.counts.compare_exchange_strong(counts, 0, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                if (shard.arenaId == arenaId)
+                    shard.data = arenaBegin(arenaId); // The active arena became empty so reuse it.
+                else
+                    shard.freeList[shard.freeListHead++] = arenaId;
+            }
+        }
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return (this == &other);
+    }
+
+private:
+    // Taps a new arena for the shard, stealing one if needed, and allocates from it.
+    // Returns nullptr if there are no free arenas in any shard. Other threads may take
+    // the stolen arenas before this thread locks the shard again, so it steals again
+    // until it finds no free arena to steal.
+    void* allocateSlow(SizeType shardId, uintptr_t numBytesNeeded)
+    {
+        Shard& shard = _shards[shardId];
+        while (true) {
+            {
+                const std::lock_guard<std::shared_mutex> lock(shard.mtx);
+                // Another thread may have tapped a new arena already.
+                bool bFits = shard.arenaId != noArena &&
+                             shard.data.load(std::memory_order_relaxed) + numBytesNeeded <= shard.end;
+                if (!bFits && shard.freeListHead > 0) {
+                    tapNextArena(shard);
+                    bFits = true;
+                }
+                if (bFits) {
+                    _numAllocationsInArena[shard.arenaId].counts.fetch_add(AllocationCounter::oneAllocation, std::memory_order_relaxed);
+                    return reinterpret_cast<void*>(shard.data.fetch_add(numBytesNeeded, std::memory_order_relaxed));
+                }
+            } // Can't steal while holding the lock.
+            if (stealArenas(shardId) == 0)
+                return nullptr;
+        }
+    }
+
+    // Retires the active arena of a locked shard and activates a free one.
+    void tapNextArena(Shard& shard)
+    {
+        SizeType retired = shard.arenaId;
+        shard.arenaId = shard.freeList[--shard.freeListHead];
+        shard.data = arenaBegin(shard.arenaId);
+        shard.end = arenaBegin(shard.arenaId) + _arenaSize;
+        // The retired arena may have become vacant while it was active.
+        if (retired != noArena) {
+            std::atomic<uint64_t>& counts = _numAllocationsInArena[retired].counts;
+            uint64_t prev = counts.load(std::memory_order_acquire);
+            if (AllocationCounter::allocations(prev) == AllocationCounter::deallocations(prev) &&
+                counts.compare_exchange_strong(prev, 0, std::memory_order_acq_rel, std::memory_order_relaxed))
+                shard.freeList[shard.freeListHead++] = retired;
+        }
+    }
+
+    // Moves half of the free arenas of the nearest shard which has any to the given shard.
+    // Only one shard is locked at a time so that the shards can't deadlock.
+    // Returns the number of arenas moved, which is 0 if no other shard has a free arena.
+    SizeType stealArenas(SizeType thiefId)
+    {
+        std::array<SizeType, 64> loot;
+        SizeType numStolen = 0;
+        for (SizeType i = 1; i < _numShards && numStolen == 0; ++i) {
+            Shard& victim = _shards[(thiefId + i) % _numShards];
+            const std::lock_guard<std::shared_mutex> lock(victim.mtx);
+            numStolen = std::min<SizeType>((victim.freeListHead + 1) / 2, SizeType(loot.size()));
+            for (SizeType k = 0; k < numStolen; ++k) {
+                loot[k] = victim.freeList[--victim.freeListHead];
+                _ownerShard[loot[k]].store(thiefId, std::memory_order_relaxed);
+            }
+        }
+        if (numStolen == 0)
+            return 0;
+        _numSteals.fetch_add(numStolen, std::memory_order_relaxed);
+        Shard& thief = _shards[thiefId];
+        const std::lock_guard<std::shared_mutex> lock(thief.mtx);
+        for (SizeType k = 0; k < numStolen; ++k)
+            thief.freeList[thief.freeListHead++] = loot[k];
+        return numStolen;
+    }
+
+    std::pmr::vector<AllocationCounter> _numAllocationsInArena;
+    std::pmr::vector<std::atomic<SizeType>> _ownerShard; // The shard which owns each arena.
+    std::pmr::vector<Shard> _shards;
+    std::pmr::vector<std::byte> _arenaData;
+    SizeType _numArenas;  // Number of arenas.
+    SizeType _arenaSize;  // Size of each arena in bytes.
+    SizeType _numShards;  // Number of shards.
+    std::atomic<std::size_t> _numSteals {0};
+};  // ShardedArenaResource
+
+// An arena leased from a synchronized memory resource for the exclusive use of one thread.
+// The lease is an unsynchronized memory resource whose allocations are plain bump
+// allocations without atomic read-modify-write operations or locks. The allocations are
+// counted in the resource in batches of publishInterval, so numberOfAllocations() of the
+// resource may lag behind until the lease ends. When the leased arena becomes full,
+// the lease leases the next free arena. If there are no free arenas left,
+// the allocations are made from the synchronized resource itself.
+// Objects allocated from the lease can be freed by any thread either through the lease
+// or through the synchronized resource. When the lease ends, the arena goes back to the free
+// list if it is empty. Otherwise it becomes a normal busy arena of the synchronized resource.
+// The lease ends when it goes out of scope or when release() is called.
+// A lease is also used for holding the arenas reserved with reserve(bytes, count)
+// by either a synchronized or an unsynchronized resource.
+template <class Resource>
+class ArenaLease : public std::pmr::memory_resource
+{
+public:
+    // A lease which holds nothing.
+    ArenaLease() = default;
+
+    // Leases a free arena. If numReservedArenas is not zero, the given number of arenas
+    // have been reserved for the lease and the lease taps them before any other arenas.
+    explicit ArenaLease(Resource& resource, SizeType numReservedArenas = 0)
+        : _resource(&resource), _numReservedArenas(numReservedArenas)
+    {
+        beginLease();
+    }
+
+    ArenaLease(ArenaLease&& other) noexcept
+        : _resource(other._resource), _data(other._data), _end(other._end),
+          _arenaId(other._arenaId), _numAllocations(other._numAllocations),
+          _numPublished(other._numPublished), _numReservedArenas(other._numReservedArenas)
+    {
+        other._arenaId = Resource::noArena;
+        other._numReservedArenas = 0;
+    }
+
+    ArenaLease& operator=(ArenaLease&& other) noexcept
+    {
+        if (this != &other) {
+            release();
+            _resource = other._resource;
+            _data = other._data;
+            _end = other._end;
+            _arenaId = other._arenaId;
+            _numAllocations = other._numAllocations;
+            _numPublished = other._numPublished;
+            _numReservedArenas = other._numReservedArenas;
+            other._arenaId = Resource::noArena;
+            other._numReservedArenas = 0;
+        }
+        return *this;
+    }
+
+    ~ArenaLease()
+    {
+        release();
+    }
+
+    // Returns true if the lease holds an arena.
+    bool valid() const { return _arenaId != Resource::noArena; }
+
+    // Id of the leased arena.
+    SizeType arenaId() const { return _arenaId; }
+
+    // Number of reserved arenas which have not been tapped yet.
+    SizeType reservedArenas() const { return _numReservedArenas; }
+
+    // Ends the lease and returns the reserved arenas which were not tapped.
+    void release()
+    {
+        endLease();
+        if (_numReservedArenas > 0) {
+            _resource->endReservation(_numReservedArenas);
+            _numReservedArenas = 0;
+        }
+    }
+
+protected:
+    // Returns pointer to a block of data whose size it at least bytes
+    // and which is aligned to alignof(max_align_t) just like in the synchronized resource.
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        constexpr std::size_t binSize = alignof(max_align_t);
+        std::size_t numBytesNeeded = (bytes + binSize - 1) / binSize * binSize;
+        if (bytes == 0 || numBytesNeeded > _resource->arenaSize())
+            return _resource->allocate(bytes, alignment); // Let the resource deal with it.
+        if (_end - _data < numBytesNeeded) { // The leased arena is full so lease the next one.
+            endLease();
+            beginLease();
+            if (!valid())
+                return _resource->allocate(bytes, alignment);
+        }
+        void* result = reinterpret_cast<void*>(_data);
+        _data += numBytesNeeded;
+        if (++_numAllocations - _numPublished == publishInterval) { // Publish a batch of allocations.
+            _resource->publishLease(_arenaId, publishInterval);
+            _numPublished = _numAllocations;
+        }
+        return result;
+    }
+
+    void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override
+    {
+        _resource->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return (this == &other);
+    }
+
+private:
+    void beginLease()
+    {
+        bool bReserved = _numReservedArenas > 0;
+        _arenaId = _resource->beginLease(bReserved);
+        if (bReserved)
+            --_numReservedArenas;
+        _data = _end = 0;
+        _numAllocations = _numPublished = 0;
+        if (valid()) {
+            _data = _resource->arenaBegin(_arenaId);
+            _end = _resource->arenaBegin(_arenaId + 1);
+        }
+    }
+
+    void endLease()
+    {
+        if (valid()) {
+            _resource->endLease(_arenaId, _numAllocations - _numPublished);
+            _arenaId = Resource::noArena;
+        }
+    }
+
+    // Number of allocations published to the resource at once.
+    static constexpr SizeType publishInterval = 64;
+
+    Resource* _resource = nullptr;
+    uintptr_t _data = 0;            // Pointer to the next free address within the leased arena.
+    uintptr_t _end = 0;             // One past the last byte of the leased arena.
+    SizeType _arenaId = Resource::noArena;
+    SizeType _numAllocations = 0;   // Number of allocations made in the leased arena.
+    SizeType _numPublished = 0;     // Number of allocations already counted by the resource.
+    SizeType _numReservedArenas = 0; // Number of reserved arenas not tapped yet.
+};
+
+// A thread allocation buffer (TLAB) of a synchronized memory resource for one thread.
+// The buffer claims a slice of the active arena of the resource with one atomic
+// operation and then allocates from the slice by bumping a plain pointer.
+// The arena is charged for as many allocations as the slice can hold when the slice
+// is claimed, and the unused part of the charge is taken back when the slice is returned,
+// so the allocation counter of the arena is updated twice per slice instead of once
+// per allocation. Objects allocated from the buffer can be freed by any thread either
+// through the buffer or through the resource. Until the slice is returned, the unused
+// part of the slice is counted as allocated. The slice is returned when the buffer
+// needs a new one, goes out of scope or when release() is called.
+//   auto buffer = arenaResource.threadAllocationBuffer(4096);
+template <class Resource>
+class ThreadAllocationBuffer : public std::pmr::memory_resource
 {
 public:
-    using Base = SynchronizedArenaResourceBase<SynchronizedArenaResource<0, 0>>;
-    explicit SynchronizedArenaResource(SizeType numArenas, SizeType arenaSize, std::pmr::memory_resource* mr = nullptr)
-        : Base(numArenas, arenaSize), _numArenas(numArenas), _arenaSize(arenaSize)
+    // A buffer which holds nothing.
+    ThreadAllocationBuffer() = default;
+
+    // The slice size is rounded up to alignof(max_align_t) and clamped to the arena size.
+    explicit ThreadAllocationBuffer(Resource& resource, SizeType sliceSize = 4096)
+        : _resource(&resource)
     {
-        assert(numArenas > 0);
-        assert(arenaSize % alignof(std::max_align_t) == 0);
-        if (!mr)
-            mr = std::pmr::new_delete_resource();
+        constexpr SizeType binSize = alignof(max_align_t);
+        _sliceSize = std::min((sliceSize + binSize - 1) / binSize * binSize, resource.arenaSize());
+    }
 
-        // Allocate arenas using the given memory resource.
-        constructPmrContainerAt(&_numAllocationsInArena, mr, numArenas);
-        constructPmrContainerAt(&_freeList, mr, numArenas);
-        constructPmrContainerAt(&_arenaData, mr, numArenas * arenaSize, std::byte{});
+    ThreadAllocationBuffer(ThreadAllocationBuffer&& other) noexcept
+        : _resource(other._resource), _data(other._data), _end(other._end), _arenaId(other._arenaId),
+          _numUnusedBlocks(other._numUnusedBlocks), _sliceSize(other._sliceSize), _numSlices(other._numSlices)
+    {
+        other._arenaId = Resource::noArena;
+    }
 
-        this->initializeArenas();
+    ThreadAllocationBuffer& operator=(ThreadAllocationBuffer&& other) noexcept
+    {
+        if (this != &other) {
+            release();
+            _resource = other._resource;
+            _data = other._data;
+            _end = other._end;
+            _arenaId = other._arenaId;
+            _numUnusedBlocks = other._numUnusedBlocks;
+            _sliceSize = other._sliceSize;
+            _numSlices = other._numSlices;
+            other._arenaId = Resource::noArena;
+        }
+        return *this;
     }
 
-    SizeType numArenas() const { return _numArenas; }
-    SizeType arenaSize() const { return _arenaSize; }
+    ~ThreadAllocationBuffer()
+    {
+        release();
+    }
 
-    friend class SynchronizedArenaResourceBase<SynchronizedArenaResource<0, 0>>;
+    // Size of the slices in bytes.
+    SizeType sliceSize() const { return _sliceSize; }
+
+    // Number of slices claimed from the resource.
+    std::size_t numberOfSlices() const { return _numSlices; }
+
+    // Returns the current slice to the resource. The next allocation claims a new one.
+    void release()
+    {
+        if (_arenaId != Resource::noArena) {
+            _resource->returnSlice(_arenaId, _numUnusedBlocks);
+            _arenaId = Resource::noArena;
+            _data = _end = 0;
+        }
+    }
 
 protected:
-    // Number of allocations and deallocation done in each arena since the arena was activated.
-    std::pmr::vector<AllocationCounter> _numAllocationsInArena;
-    // List of free arenas.
-    std::pmr::vector<SizeType> _freeList;
-    std::pmr::vector<std::byte> _arenaData;
-    SizeType _numArenas;  // Number of arenas.
-    SizeType _arenaSize;  // Size of each arena in bytes.
-};  // SynchronizedArenaResource in stack
+    // Returns pointer to a block of data whose size it at least bytes
+    // and which is aligned to alignof(max_align_t) just like in the synchronized resource.
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        constexpr std::size_t binSize = alignof(max_align_t);
+        std::size_t numBytesNeeded = (bytes + binSize - 1) / binSize * binSize;
+        if (bytes == 0 || numBytesNeeded > _sliceSize)
+            return _resource->allocate(bytes, alignment); // Let the resource deal with it.
+        if (_end - _data < numBytesNeeded) { // The slice is full so claim the next one.
+            release();
+            void* slice = _resource->claimSlice(_sliceSize, _sliceSize / SizeType(binSize));
+            if (slice == nullptr)
+                return _resource->allocate(bytes, alignment); // Out of arenas. Let the resource deal with it.
+            _data = reinterpret_cast<uintptr_t>(slice);
+            _end = _data + _sliceSize;
+            _arenaId = SizeType((_data - _resource->arenaBegin(0)) / _resource->arenaSize());
+            _numUnusedBlocks = _sliceSize / SizeType(binSize);
+            ++_numSlices;
+        }
+        void* result = reinterpret_cast<void*>(_data);
+        _data += numBytesNeeded;
+        --_numUnusedBlocks;
+        return result;
+    }
+
+    void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override
+    {
+        _resource->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return (this == &other);
+    }
+
+private:
+    Resource* _resource = nullptr;
+    uintptr_t _data = 0;             // Pointer to the next free address within the slice.
+    uintptr_t _end = 0;              // One past the last byte of the slice.
+    SizeType _arenaId = Resource::noArena; // Id of the arena of the slice.
+    SizeType _numUnusedBlocks = 0;   // Number of allocations charged to the arena but not made yet.
+    SizeType _sliceSize = 0;         // Size of each slice in bytes.
+    std::size_t _numSlices = 0;      // Number of slices claimed.
+};
 
 // Synchronized (i.e. thread-safe) memory resource which otherwise is
 // like SynchronizedArenaResource above except that it keep track of every
@@ -883,19 +3590,85 @@ public:
     // All-time high number of allocations
     std::size_t maxNumberOfAllocations = 0;
 
-private:
-    void* do_allocate(std::size_t bytes, std::size_t alignment) override
+    // Allocates from the active arena of the given lifetime class
+    // and keeps track of the allocation.
+    void* allocateFor(Lifetime lifetime, std::size_t bytes, std::size_t alignment = alignof(std::max_align_t))
+    {
+        if (bytes == 0)
+            return nullptr;
+        const std::lock_guard<std::mutex> lock(_mtx);
+        void* p = Base::allocateFor(lifetime, bytes, alignment);
+        _map[p] = bytes;
+        maxBusyArenas = std::max(maxBusyArenas, std::size_t(this->numberOfBusyArenas()));
+        maxNumberOfAllocations = std::max(maxNumberOfAllocations, _map.size());
+        return p;
+    }
+
+    // Allocates near the given address and keeps track of the allocation.
+    void* allocateNear(const void* p, std::size_t bytes, std::size_t alignment = alignof(std::max_align_t))
+    {
+        if (bytes == 0)
+            return nullptr;
+        const std::lock_guard<std::mutex> lock(_mtx);
+        void* result = Base::allocateNear(p, bytes, alignment);
+        _map[result] = bytes;
+        maxBusyArenas = std::max(maxBusyArenas, std::size_t(this->numberOfBusyArenas()));
+        maxNumberOfAllocations = std::max(maxNumberOfAllocations, _map.size());
+        return result;
+    }
+
+    // Allocates with the given priority and keeps track of the allocation.
+    void* allocateWithPriority(Priority priority, std::size_t bytes, std::size_t alignment = alignof(std::max_align_t))
     {
         if (bytes == 0)
             return nullptr;
         const std::lock_guard<std::mutex> lock(_mtx);
-        void* p = Base::do_allocate(bytes, alignment);
+        void* p = Base::allocateWithPriority(priority, bytes, alignment);
         _map[p] = bytes;
         maxBusyArenas = std::max(maxBusyArenas, std::size_t(this->numberOfBusyArenas()));
         maxNumberOfAllocations = std::max(maxNumberOfAllocations, _map.size());
         return p;
     }
 
+    // Allocates at least the given number of bytes and keeps track of the allocation.
+    AllocationResult allocateAtLeast(std::size_t bytes, std::size_t alignment = alignof(std::max_align_t))
+    {
+        if (bytes == 0)
+            return {nullptr, 0};
+        const std::lock_guard<std::mutex> lock(_mtx);
+        AllocationResult result = Base::allocateAtLeast(bytes, alignment);
+        _map[result.ptr] = result.count;
+        maxBusyArenas = std::max(maxBusyArenas, std::size_t(this->numberOfBusyArenas()));
+        maxNumberOfAllocations = std::max(maxNumberOfAllocations, _map.size());
+        return result;
+    }
+
+    // Releases all allocations at once and forgets them.
+    void release()
+    {
+        const std::lock_guard<std::mutex> lock(_mtx);
+        Base::release();
+        _map.clear();
+    }
+
+    // Allocations made through a reservation would bypass the statistics.
+    ArenaLease<Base> reserve(std::size_t bytes, std::size_t count) = delete;
+
+    // Releases and forgets everything allocated after the marker.
+    void rollback(const Marker& marker)
+    {
+        const std::lock_guard<std::mutex> lock(_mtx);
+        for (auto it = _map.begin(); it != _map.end(); )
+            it = this->allocatedAfterMark(it->first) ? _map.erase(it) : std::next(it);
+        Base::rollback(marker);
+    }
+
+private:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        return allocateFor(Lifetime::Default, bytes, alignment);
+    }
+
     void do_deallocate(void* p,
                        std::size_t bytes = 0,
                        std::size_t alignment = alignof(std::max_align_t)) override
@@ -917,6 +3690,350 @@ private:
     MapType _map;
 };
 
+// Memory resource which routes the allocations of a MultiArena resource
+// to the active arena of the given lifetime class. Deallocations go to the
+// underlying resource as usual. Can be passed to std::pmr containers like so:
+//   MultiArena::LifetimeView sessionResource(arenaResource, MultiArena::Lifetime::Session);
+//   std::pmr::vector<int> vec(&sessionResource);
+template <class Resource>
+class LifetimeView : public std::pmr::memory_resource
+{
+public:
+    LifetimeView(Resource& resource, Lifetime lifetime) : _resource(&resource), _lifetime(lifetime)
+    { }
+
+    Resource* resource() const { return _resource; }
+    Lifetime lifetime() const { return _lifetime; }
+
+protected:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        return _resource->allocateFor(_lifetime, bytes, alignment);
+    }
+
+    void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override
+    {
+        _resource->deallocate(p, bytes, alignment);
+    }
+
+    // Views to the same resource can deallocate each other's memory.
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        auto otherView = dynamic_cast<const LifetimeView*>(&other);
+        return (this == &other) || (otherView && otherView->_resource == _resource);
+    }
+
+private:
+    Resource* _resource;
+    Lifetime _lifetime;
+};
+
+// Memory resource which makes the allocations of a MultiArena resource
+// with the given priority. Deallocations go to the underlying resource as usual.
+//   MultiArena::PriorityView controlResource(arenaResource, MultiArena::Priority::High);
+template <class Resource>
+class PriorityView : public std::pmr::memory_resource
+{
+public:
+    PriorityView(Resource& resource, Priority priority) : _resource(&resource), _priority(priority)
+    { }
+
+    Resource* resource() const { return _resource; }
+    Priority priority() const { return _priority; }
+
+protected:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        return _resource->allocateWithPriority(_priority, bytes, alignment);
+    }
+
+    void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override
+    {
+        _resource->deallocate(p, bytes, alignment);
+    }
+
+    // Views to the same resource can deallocate each other's memory.
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        auto otherView = dynamic_cast<const PriorityView*>(&other);
+        return (this == &other) || (otherView && otherView->_resource == _resource);
+    }
+
+private:
+    Resource* _resource;
+    Priority _priority;
+};
+
+// One tier of a MultiArenaSet: NUM_ARENAS arenas of ARENA_SIZE bytes each.
+template <SizeType NUM_ARENAS, SizeType ARENA_SIZE>
+struct Tier
+{
+    static constexpr SizeType numArenas = NUM_ARENAS;
+    static constexpr SizeType arenaSize = ARENA_SIZE;
+};
+
+// Returns the smallest k such that 2^k >= n.
+constexpr unsigned ceilLog2(std::size_t n)
+{
+    unsigned k = 0;
+    while ((std::size_t(1) << k) < n)
+        ++k;
+    return k;
+}
+
+// Maps size class k (i.e. 2^(k-1) < bytes <= 2^k) to the index of the first
+// arena size which can hold the smallest allocation in the class.
+// The arena sizes must be in increasing order.
+template <std::size_t N>
+constexpr auto makeSizeClassTable(const std::array<SizeType, N>& arenaSizes)
+{
+    std::array<uint8_t, 8 * sizeof(std::size_t) + 1> table{};
+    for (std::size_t k = 0; k < table.size(); ++k) {
+        std::size_t minBytesInClass = (k == 0) ? 1 : (std::size_t(1) << (k - 1)) + 1;
+        std::size_t index = 0;
+        while (index < N - 1 && arenaSizes[index] < minBytesInClass)
+            ++index;
+        table[k] = uint8_t(index);
+    }
+    return table;
+}
+
+// Memory resource which composes several tiers of arenas behind one interface.
+// Each tier is a MultiArena resource of type Resource<NUM_ARENAS, ARENA_SIZE>
+// with its own arena size. An allocation is carved from the tier with the smallest
+// arena which can hold it, so small and large blocks do not need to share one
+// arena size. The tiers must be listed in the order of increasing arena size.
+// Deallocation finds the tier from the address range of its arenas.
+template <template <SizeType, SizeType> class Resource, class... Tiers>
+class BasicMultiArenaSet : public std::pmr::memory_resource
+{
+public:
+    static constexpr std::size_t numTiers = sizeof...(Tiers);
+
+    BasicMultiArenaSet()
+    {
+        static_assert(numTiers > 0, "There must be at least one tier.");
+        static_assert(numTiers < 256, "Too many tiers.");
+        static_assert(isSortedByArenaSize(), "Tiers must be listed in the order of increasing arena size.");
+        std::apply([this](auto&... tier) {
+            std::size_t i = 0;
+            ((_tierResources[i++] = &tier), ...);
+        }, _tiers);
+    }
+
+    // Total number of allocations combined in all tiers.
+    std::size_t numberOfAllocations()
+    {
+        return std::apply([](auto&... tier) {
+            return (std::size_t(0) + ... + tier.numberOfAllocations());
+        }, _tiers);
+    }
+
+    // Number of non-empty arenas in all tiers.
+    SizeType numberOfBusyArenas()
+    {
+        return std::apply([](auto&... tier) {
+            return (SizeType(0) + ... + tier.numberOfBusyArenas());
+        }, _tiers);
+    }
+
+    // Total number of arenas in all tiers.
+    static constexpr SizeType numArenas() { return (SizeType(0) + ... + Tiers::numArenas); }
+
+    // Size of the largest arena, i.e. the largest possible allocation.
+    static constexpr SizeType maxArenaSize() { return arenaSizes[numTiers - 1]; }
+
+    // Total number of bytes in the arenas of all tiers.
+    static constexpr std::size_t totalArenaBytes()
+    {
+        return (std::size_t(0) + ... + (std::size_t(Tiers::numArenas) * Tiers::arenaSize));
+    }
+
+    // Returns the memory resource of the I'th tier.
+    template <std::size_t I>
+    auto& tier() { return std::get<I>(_tiers); }
+
+    // Returns the index of the tier from which an allocation of the given size
+    // will be made, or numTiers if the allocation is too large for every tier.
+    static constexpr std::size_t tierIndex(std::size_t bytes)
+    {
+        if (bytes > maxArenaSize())
+            return numTiers;
+        std::size_t index = tierOfSizeClass[ceilLog2(bytes)];
+        // The size class may span several tiers so step to the first one which fits.
+        while (bytes > arenaSizes[index])
+            ++index;
+        return index;
+    }
+
+    bool contains(const void* p) const
+    {
+        return std::apply([p](const auto&... tier) { return (tier.contains(p) || ...); }, _tiers);
+    }
+
+    // Releases all allocations in every tier at once.
+    void release()
+    {
+        std::apply([](auto&... tier) { (tier.release(), ...); }, _tiers);
+    }
+
+protected:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        if (bytes == 0)
+            return nullptr;
+        std::size_t index = tierIndex(bytes);
+        if (index == numTiers) {
+            if constexpr (exceptionsEnabled)
+                throw AllocateTooLargeBlock(bytes, maxArenaSize());
+            return nullptr;
+        }
+        return _tierResources[index]->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* p,
+                       std::size_t bytes = 0,
+                       std::size_t alignment = alignof(std::max_align_t)) override
+    {
+        if (p == nullptr)
+            return;
+        bool bFound = std::apply([=](auto&... tier) {
+            return ((tier.contains(p) ? (tier.deallocate(p, bytes, alignment), true) : false) || ...);
+        }, _tiers);
+        if constexpr (exceptionsEnabled) {
+            if (!bFound) // There is either double-free or memory corruption
+                throw ArenaMemoryResourceCorruption(p, bytes, alignment);
+        }
+        (void)bFound;
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return (this == &other);
+    }
+
+private:
+    static constexpr std::array<SizeType, numTiers> arenaSizes = { Tiers::arenaSize... };
+
+    static constexpr bool isSortedByArenaSize()
+    {
+        for (std::size_t i = 1; i < numTiers; ++i)
+            if (arenaSizes[i - 1] >= arenaSizes[i])
+                return false;
+        return true;
+    }
+
+    static constexpr auto tierOfSizeClass = makeSizeClassTable(arenaSizes);
+
+    std::tuple<Resource<Tiers::numArenas, Tiers::arenaSize>...> _tiers;
+    // The tiers as memory resources for run-time dispatch.
+    std::array<std::pmr::memory_resource*, numTiers> _tierResources;
+};
+
+// Unsynchronized (i.e. non-thread-safe) set of arena tiers.
+// Example: MultiArenaSet<Tier<64, 4096>, Tier<8, 1 << 20>>
+template <class... Tiers>
+using MultiArenaSet = BasicMultiArenaSet<UnsynchronizedArenaResource, Tiers...>;
+
+// Synchronized (i.e. thread-safe) set of arena tiers.
+template <class... Tiers>
+using SynchronizedMultiArenaSet = BasicMultiArenaSet<SynchronizedArenaResource, Tiers...>;
+
+// Memory resource for pipelines where frame N is produced while frame N-1 is still being consumed.
+// Each frame is allocated from a pool of its own so the frames never share arenas.
+// The pools rotate on nextFrame() and the pool of the oldest frame is released all at once
+// when every consumer of that frame has called releaseFrame(). Objects can still be deallocated
+// one by one while their frame is alive but there is no need to do so.
+// Only the producer thread may call retainFrame() and nextFrame(), so it retains a frame
+// on behalf of its consumers before handing the frame over. The consumers may call
+// releaseFrame() from any thread.
+// Pool can be either a synchronized or an unsynchronized arena resource. With an unsynchronized
+// pool, only the producer may allocate and deallocate.
+// Example: FrameArenaResource<SynchronizedArenaResource<64, 4096>, 2> frameResource;
+template <class Pool, std::size_t NUM_POOLS = 2>
+class FrameArenaResource : public std::pmr::memory_resource
+{
+public:
+    static_assert(NUM_POOLS >= 2, "There must be at least two pools.");
+
+    // The arguments are passed to the constructor of each pool.
+    template <class... Args>
+    explicit FrameArenaResource(const Args&... args)
+        : _pools(makePools(std::make_index_sequence<NUM_POOLS>{}, args...))
+    { }
+
+    // Index of the pool of the frame which is being produced.
+    std::size_t currentFrame() const { return _current.load(std::memory_order_relaxed); }
+
+    Pool& pool(std::size_t index) { return _pools[index]; }
+
+    // Registers a consumer of the current frame. Returns the index of the frame
+    // which must be passed to releaseFrame() when the consumer is done with it.
+    // Must be called by the producer thread.
+    std::size_t retainFrame()
+    {
+        std::size_t current = currentFrame();
+        _numConsumers[current].fetch_add(1, std::memory_order_relaxed);
+        return current;
+    }
+
+    // Signals that a consumer is done with the given frame.
+    void releaseFrame(std::size_t frame)
+    {
+        MULTIARENA_ASSERT(_numConsumers[frame] > 0);
+        _numConsumers[frame].fetch_sub(1, std::memory_order_release);
+    }
+
+    // Starts a new frame in the pool of the oldest frame. Returns false and
+    // stays in the current frame if the oldest frame still has consumers.
+    // Must be called by the producer thread.
+    bool nextFrame()
+    {
+        std::size_t next = (currentFrame() + 1) % NUM_POOLS;
+        if (_numConsumers[next].load(std::memory_order_acquire) > 0)
+            return false;
+        _pools[next].release();
+        _current.store(next, std::memory_order_relaxed);
+        return true;
+    }
+
+protected:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        return _pools[currentFrame()].allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override
+    {
+        for (Pool& pool : _pools) {
+            if (pool.contains(p)) {
+                pool.deallocate(p, bytes, alignment);
+                return;
+            }
+        }
+        if constexpr (exceptionsEnabled) {
+            if (p != nullptr) // There is either double-free or memory corruption
+                throw ArenaMemoryResourceCorruption(p, bytes, alignment);
+        }
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return (this == &other);
+    }
+
+private:
+    template <std::size_t... I, class... Args>
+    static std::array<Pool, NUM_POOLS> makePools(std::index_sequence<I...>, const Args&... args)
+    {
+        return { ((void)I, Pool(args...))... };
+    }
+
+    std::array<Pool, NUM_POOLS> _pools;
+    std::array<std::atomic<SizeType>, NUM_POOLS> _numConsumers {};
+    std::atomic<std::size_t> _current {0}; // Written only by the producer.
+};
+
 // Deleter for a unique_ptr allocated with a polymorphic allocator.
 template <class T>
 class PolymorphicDeleter